@@ -0,0 +1,154 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#include "blob.h"
+#include <cstring>
+#include <algorithm>
+
+namespace Laretz
+{
+	namespace
+	{
+		const char EmptyData [1] = { 0 };
+	}
+
+	Blob::Blob ()
+	: m_data (std::shared_ptr<const char> (), EmptyData)
+	, m_size (0)
+	{
+	}
+
+	Blob::Blob (const char *data, size_t size)
+	: m_data (allocate (size))
+	, m_size (size)
+	{
+		if (size)
+			std::memcpy (const_cast<char*> (m_data.get ()), data, size);
+	}
+
+	Blob::Blob (const std::vector<char>& vec)
+	: Blob (vec.data (), vec.size ())
+	{
+	}
+
+	Blob::Blob (std::vector<char>&& vec)
+	: m_size (vec.size ())
+	{
+		const auto owner = std::make_shared<std::vector<char>> (std::move (vec));
+		m_data = std::shared_ptr<const char> (owner, owner->data ());
+	}
+
+	Blob::Blob (const std::string& str)
+	: Blob (str.data (), str.size ())
+	{
+	}
+
+	Blob::Blob (std::shared_ptr<const void> owner, const char *data, size_t size)
+	: m_data (owner, data)
+	, m_size (size)
+	{
+	}
+
+	const char* Blob::data () const
+	{
+		return m_data.get ();
+	}
+
+	size_t Blob::size () const
+	{
+		return m_size;
+	}
+
+	bool Blob::empty () const
+	{
+		return !m_size;
+	}
+
+	const char* Blob::begin () const
+	{
+		return m_data.get ();
+	}
+
+	const char* Blob::end () const
+	{
+		return m_data.get () + m_size;
+	}
+
+	std::vector<char> Blob::toVector () const
+	{
+		return { begin (), end () };
+	}
+
+	bool Blob::operator== (const Blob& other) const
+	{
+		return m_size == other.m_size &&
+				(m_data == other.m_data || std::equal (begin (), end (), other.begin ()));
+	}
+
+	bool Blob::operator!= (const Blob& other) const
+	{
+		return !(*this == other);
+	}
+
+	std::shared_ptr<char> Blob::allocate (size_t size)
+	{
+		return std::shared_ptr<char> (new char [size ? size : 1], std::default_delete<char []> ());
+	}
+
+	BlobRef::BlobRef ()
+	: m_size (0)
+	{
+	}
+
+	BlobRef::BlobRef (uint64_t size, const std::string& hash)
+	: m_size (size)
+	, m_hash (hash)
+	{
+	}
+
+	uint64_t BlobRef::size () const
+	{
+		return m_size;
+	}
+
+	const std::string& BlobRef::getHash () const
+	{
+		return m_hash;
+	}
+
+	bool BlobRef::operator== (const BlobRef& other) const
+	{
+		return m_size == other.m_size && m_hash == other.m_hash;
+	}
+
+	bool BlobRef::operator!= (const BlobRef& other) const
+	{
+		return !(*this == other);
+	}
+}
@@ -0,0 +1,195 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#pragma once
+
+#include <memory>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <boost/mpl/bool.hpp>
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/array_wrapper.hpp>
+#include <boost/serialization/collection_size_type.hpp>
+#include <boost/serialization/item_version_type.hpp>
+#include <boost/serialization/level.hpp>
+#include <boost/serialization/library_version_type.hpp>
+#include <boost/serialization/nvp.hpp>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/array_optimization.hpp>
+
+namespace Laretz
+{
+	// Immutable reference-counted byte buffer. Copies share the data, and
+	// the data may alias a buffer owned by someone else, like a BSON object.
+	// Serialized exactly like std::vector<char>.
+	class Blob
+	{
+		std::shared_ptr<const char> m_data;
+		size_t m_size;
+
+		friend class boost::serialization::access;
+	public:
+		Blob ();
+		Blob (const char *data, size_t size);
+		Blob (const std::vector<char>&);
+		Blob (std::vector<char>&&);
+		explicit Blob (const std::string&);
+		Blob (std::shared_ptr<const void> owner, const char *data, size_t size);
+
+		const char* data () const;
+		size_t size () const;
+		bool empty () const;
+
+		const char* begin () const;
+		const char* end () const;
+
+		std::vector<char> toVector () const;
+
+		bool operator== (const Blob&) const;
+		bool operator!= (const Blob&) const;
+	private:
+		static std::shared_ptr<char> allocate (size_t);
+
+		template<typename Ar>
+		void save (Ar& ar, const unsigned int) const
+		{
+			typedef typename boost::serialization::use_array_optimization<Ar>::template apply<char>::type Optimized_t;
+			saveData (ar, Optimized_t ());
+		}
+
+		template<typename Ar>
+		void load (Ar& ar, const unsigned int)
+		{
+			typedef typename boost::serialization::use_array_optimization<Ar>::template apply<char>::type Optimized_t;
+			loadData (ar, Optimized_t ());
+		}
+
+		template<typename Ar>
+		void saveData (Ar& ar, boost::mpl::false_) const
+		{
+			using namespace boost::serialization;
+
+			const collection_size_type count (m_size);
+			ar << BOOST_SERIALIZATION_NVP (count);
+
+			const item_version_type item_version (0);
+			ar << BOOST_SERIALIZATION_NVP (item_version);
+
+			for (auto p = begin (); p != end (); ++p)
+				ar << make_nvp ("item", *p);
+		}
+
+		template<typename Ar>
+		void loadData (Ar& ar, boost::mpl::false_)
+		{
+			using namespace boost::serialization;
+
+			collection_size_type count;
+			ar >> BOOST_SERIALIZATION_NVP (count);
+
+			item_version_type item_version (0);
+			if (library_version_type (3) < ar.get_library_version ())
+				ar >> BOOST_SERIALIZATION_NVP (item_version);
+
+			const auto buffer = allocate (count);
+			for (size_t i = 0; i < count; ++i)
+				ar >> make_nvp ("item", buffer.get () [i]);
+
+			m_data = buffer;
+			m_size = count;
+		}
+
+		template<typename Ar>
+		void saveData (Ar& ar, boost::mpl::true_) const
+		{
+			using namespace boost::serialization;
+
+			const collection_size_type count (m_size);
+			ar << BOOST_SERIALIZATION_NVP (count);
+			if (m_size)
+				ar << make_array<const char, collection_size_type> (data (), count);
+		}
+
+		template<typename Ar>
+		void loadData (Ar& ar, boost::mpl::true_)
+		{
+			using namespace boost::serialization;
+
+			collection_size_type count;
+			ar >> BOOST_SERIALIZATION_NVP (count);
+
+			const library_version_type version (ar.get_library_version ());
+			if (version == library_version_type (4) || version == library_version_type (5))
+			{
+				unsigned int item_version = 0;
+				ar >> BOOST_SERIALIZATION_NVP (item_version);
+			}
+
+			const auto buffer = allocate (count);
+			if (count)
+				ar >> make_array<char, collection_size_type> (buffer.get (), count);
+
+			m_data = buffer;
+			m_size = count;
+		}
+
+		BOOST_SERIALIZATION_SPLIT_MEMBER ()
+	};
+
+	// Stands in for a blob field when the contents are not transferred:
+	// the size and the hex-encoded SHA-256 of the data.
+	class BlobRef
+	{
+		uint64_t m_size;
+		std::string m_hash;
+
+		friend class boost::serialization::access;
+	public:
+		BlobRef ();
+		BlobRef (uint64_t size, const std::string& hash);
+
+		uint64_t size () const;
+		const std::string& getHash () const;
+
+		bool operator== (const BlobRef&) const;
+		bool operator!= (const BlobRef&) const;
+	private:
+		template<typename Ar>
+		void serialize (Ar& ar, const unsigned int)
+		{
+			ar & boost::serialization::make_nvp ("size", m_size);
+			ar & boost::serialization::make_nvp ("hash", m_hash);
+		}
+	};
+}
+
+BOOST_CLASS_IMPLEMENTATION (Laretz::Blob, boost::serialization::object_serializable)
+BOOST_CLASS_IMPLEMENTATION (Laretz::BlobRef, boost::serialization::object_serializable)
@@ -0,0 +1,431 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#include "client.h"
+#include <deque>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/lexical_cast.hpp>
+#include "packetgenerator.h"
+#include "compression.h"
+#include "compactlist.h"
+
+namespace Laretz
+{
+	namespace asio = boost::asio;
+	using asio::ip::tcp;
+
+	class Client::Connection : public std::enable_shared_from_this<Connection>
+								, private boost::noncopyable
+	{
+		asio::io_service::strand& m_strand;
+		const ClientSettings& m_settings;
+		const NotifyHandler_t& m_notifyHandler;
+
+		tcp::resolver m_resolver;
+		tcp::socket m_socket;
+
+		enum class State
+		{
+			Disconnected,
+			Connecting,
+			Connected
+		} m_state;
+
+		// Bumped on every failure, so completions queued for a socket that
+		// has been closed since then are told apart and ignored.
+		unsigned m_generation;
+
+		std::deque<std::string> m_outQueue;
+		bool m_writing;
+
+		std::deque<ReplyHandler_t> m_pending;
+		bool m_reading;
+		bool m_subscribed;
+		asio::streambuf m_buf;
+
+		std::unique_ptr<Deflater> m_deflater;
+		std::unique_ptr<Inflater> m_inflater;
+	public:
+		Connection (asio::io_service& io, asio::io_service::strand& strand,
+				const ClientSettings& settings, const NotifyHandler_t& notifyHandler)
+		: m_strand (strand)
+		, m_settings (settings)
+		, m_notifyHandler (notifyHandler)
+		, m_resolver (io)
+		, m_socket (io)
+		, m_state (State::Disconnected)
+		, m_generation (0)
+		, m_writing (false)
+		, m_reading (false)
+		, m_subscribed (false)
+		{
+		}
+
+		size_t getPendingCount () const
+		{
+			return m_pending.size ();
+		}
+
+		void send (const PacketGenerator& pg, const ReplyHandler_t& handler)
+		{
+			if (m_state == State::Disconnected)
+				connect ();
+
+			m_outQueue.push_back (m_settings.m_compress ? pg (*m_deflater) : pg ());
+			m_pending.push_back (handler);
+
+			if (m_state == State::Connected)
+			{
+				writeNext ();
+				readNext ();
+			}
+		}
+
+		void setSubscribed ()
+		{
+			m_subscribed = true;
+		}
+
+		void close ()
+		{
+			fail (asio::error::operation_aborted);
+		}
+	private:
+		void connect ()
+		{
+			m_state = State::Connecting;
+			m_deflater.reset (new Deflater);
+			m_inflater.reset (new Inflater);
+
+			auto shared = shared_from_this ();
+			const auto gen = m_generation;
+			m_resolver.async_resolve (tcp::resolver::query (m_settings.m_host, m_settings.m_port),
+					m_strand.wrap ([shared, gen] (const boost::system::error_code& ec, tcp::resolver::iterator it)
+						{
+							if (gen != shared->m_generation)
+								return;
+
+							if (ec)
+								shared->fail (ec);
+							else
+								shared->handleResolved (it);
+						}));
+		}
+
+		void handleResolved (tcp::resolver::iterator it)
+		{
+			auto shared = shared_from_this ();
+			const auto gen = m_generation;
+			asio::async_connect (m_socket, it,
+					m_strand.wrap ([shared, gen] (const boost::system::error_code& ec, tcp::resolver::iterator)
+						{
+							if (gen != shared->m_generation)
+								return;
+
+							if (ec)
+							{
+								shared->fail (ec);
+								return;
+							}
+
+							shared->m_state = State::Connected;
+							shared->writeNext ();
+							shared->readNext ();
+						}));
+		}
+
+		void writeNext ()
+		{
+			if (m_writing || m_outQueue.empty ())
+				return;
+
+			m_writing = true;
+
+			auto shared = shared_from_this ();
+			const auto gen = m_generation;
+			asio::async_write (m_socket, asio::buffer (m_outQueue.front ()),
+					m_strand.wrap ([shared, gen] (const boost::system::error_code& ec, size_t)
+						{
+							if (gen != shared->m_generation)
+								return;
+
+							shared->m_writing = false;
+							if (ec)
+							{
+								shared->fail (ec);
+								return;
+							}
+
+							shared->m_outQueue.pop_front ();
+							shared->writeNext ();
+						}));
+		}
+
+		void readNext ()
+		{
+			if (m_reading || (m_pending.empty () && !m_subscribed))
+				return;
+
+			m_reading = true;
+
+			auto shared = shared_from_this ();
+			const auto gen = m_generation;
+			asio::async_read_until (m_socket, m_buf, "\n\n",
+					m_strand.wrap ([shared, gen] (const boost::system::error_code& ec, size_t headerSize)
+						{
+							if (gen != shared->m_generation)
+								return;
+
+							if (ec)
+								shared->fail (ec);
+							else
+								shared->handleHeader (headerSize);
+						}));
+		}
+
+		void handleHeader (size_t headerSize)
+		{
+			const std::string header (asio::buffer_cast<const char*> (m_buf.data ()), headerSize);
+
+			const std::string lengthMarker ("Length: ");
+			const auto pos = header.find (lengthMarker);
+			size_t length = 0;
+			try
+			{
+				if (pos == std::string::npos)
+					throw std::runtime_error ("no length");
+
+				const auto numStart = pos + lengthMarker.size ();
+				length = boost::lexical_cast<size_t> (header.substr (numStart, header.find ('\n', numStart) - numStart));
+			}
+			catch (const std::exception&)
+			{
+				fail (boost::system::errc::make_error_code (boost::system::errc::bad_message));
+				return;
+			}
+
+			const auto total = headerSize + length;
+			if (m_buf.size () >= total)
+			{
+				handlePacket (total);
+				return;
+			}
+
+			auto shared = shared_from_this ();
+			const auto gen = m_generation;
+			asio::async_read (m_socket, m_buf, asio::transfer_exactly (total - m_buf.size ()),
+					m_strand.wrap ([shared, gen, total] (const boost::system::error_code& ec, size_t)
+						{
+							if (gen != shared->m_generation)
+								return;
+
+							if (ec)
+								shared->fail (ec);
+							else
+								shared->handlePacket (total);
+						}));
+		}
+
+		void handlePacket (size_t total)
+		{
+			const std::string data (asio::buffer_cast<const char*> (m_buf.data ()), total);
+			m_buf.consume (total);
+
+			ParseResult result;
+			try
+			{
+				result = Parse (data, *m_inflater);
+				for (auto& op : result.operations)
+					ExpandCompactList (op);
+			}
+			catch (const std::exception&)
+			{
+				fail (boost::system::errc::make_error_code (boost::system::errc::bad_message));
+				return;
+			}
+
+			const auto statusPos = result.fields.find ("Status");
+			const auto& status = statusPos != result.fields.end () ? statusPos->second : std::string ();
+			if (status == "Notify")
+			{
+				m_reading = false;
+				readNext ();
+
+				if (m_notifyHandler)
+					m_notifyHandler ({}, std::move (result));
+				return;
+			}
+
+			if (m_pending.empty ())
+			{
+				fail (boost::system::errc::make_error_code (boost::system::errc::protocol_error));
+				return;
+			}
+
+			const bool partial = status == "Partial";
+
+			auto handler = m_pending.front ();
+			if (!partial)
+				m_pending.pop_front ();
+
+			m_reading = false;
+			readNext ();
+
+			if (handler)
+				handler ({}, std::move (result));
+		}
+
+		void fail (const boost::system::error_code& ec)
+		{
+			++m_generation;
+
+			boost::system::error_code ignored;
+			m_resolver.cancel ();
+			m_socket.close (ignored);
+			m_buf.consume (m_buf.size ());
+
+			m_state = State::Disconnected;
+			m_reading = false;
+			m_writing = false;
+			m_outQueue.clear ();
+
+			auto pending = std::move (m_pending);
+			m_pending.clear ();
+			for (const auto& handler : pending)
+				if (handler)
+					handler (ec, ParseResult ());
+
+			if (m_subscribed)
+			{
+				m_subscribed = false;
+				if (m_notifyHandler)
+					m_notifyHandler (ec, ParseResult ());
+			}
+		}
+	};
+
+	Client::Client (asio::io_service& io, const ClientSettings& settings)
+	: m_io (io)
+	, m_strand (io)
+	, m_settings (settings)
+	{
+	}
+
+	Client::~Client ()
+	{
+	}
+
+	void Client::enqueue (const Operation& op)
+	{
+		m_strand.dispatch ([this, op] { m_summer += op; });
+	}
+
+	void Client::flush (const ReplyHandler_t& handler)
+	{
+		m_strand.dispatch ([this, handler]
+				{
+					auto ops = m_summer.takeOps ();
+					if (!ops.empty ())
+						doSend (std::move (ops), handler, HeaderFields_t ());
+					else if (handler)
+						handler ({}, ParseResult ());
+				});
+	}
+
+	void Client::send (const std::vector<Operation>& ops, const ReplyHandler_t& handler,
+			const HeaderFields_t& extraFields)
+	{
+		const auto opsPtr = std::make_shared<std::vector<Operation>> (ops);
+		m_strand.dispatch ([this, opsPtr, handler, extraFields]
+				{ doSend (std::move (*opsPtr), handler, extraFields); });
+	}
+
+	void Client::setNotifyHandler (const NotifyHandler_t& handler)
+	{
+		m_strand.dispatch ([this, handler] { m_notifyHandler = handler; });
+	}
+
+	void Client::subscribe (const Operation& op, const ReplyHandler_t& handler)
+	{
+		m_strand.dispatch ([this, op, handler]
+				{
+					if (!m_subscribedConn)
+						m_subscribedConn = pickConnection ();
+
+					m_subscribedConn->setSubscribed ();
+					m_subscribedConn->send (makePacket ({ op }, HeaderFields_t ()), handler);
+				});
+	}
+
+	void Client::close ()
+	{
+		m_strand.dispatch ([this]
+				{
+					for (const auto& conn : m_connections)
+						conn->close ();
+				});
+	}
+
+	PacketGenerator Client::makePacket (std::vector<Operation>&& ops, const HeaderFields_t& extraFields) const
+	{
+		HeaderFields_t fields { extraFields };
+		fields ["Login"] = m_settings.m_login;
+		fields ["Password"] = m_settings.m_password;
+		if (m_settings.m_compress)
+			fields ["Accept-Encoding"] = "deflate";
+
+		PacketGenerator pg { std::move (fields) };
+		pg [std::move (ops)];
+		return pg;
+	}
+
+	void Client::doSend (std::vector<Operation>&& ops, const ReplyHandler_t& handler, const HeaderFields_t& extraFields)
+	{
+		pickConnection ()->send (makePacket (std::move (ops), extraFields), handler);
+	}
+
+	auto Client::pickConnection () -> Connection_ptr
+	{
+		Connection_ptr best;
+		for (const auto& conn : m_connections)
+			if (!best || conn->getPendingCount () < best->getPendingCount ())
+				best = conn;
+
+		if (best && (!best->getPendingCount () || m_connections.size () >= std::max<size_t> (m_settings.m_connections, 1)))
+			return best;
+
+		m_connections.push_back (std::make_shared<Connection> (m_io, m_strand, m_settings, m_notifyHandler));
+		return m_connections.back ();
+	}
+}
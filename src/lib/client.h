@@ -0,0 +1,103 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/strand.hpp>
+#include "packetparser.h"
+#include "packetgenerator.h"
+#include "opsummer.h"
+
+namespace Laretz
+{
+	struct ClientSettings
+	{
+		std::string m_host = "localhost";
+		std::string m_port = "54093";
+
+		std::string m_login;
+		std::string m_password;
+
+		size_t m_connections = 1;
+		bool m_compress = true;
+	};
+
+	// Keeps persistent connections to the server and pipelines requests
+	// over them. All the callbacks are invoked from the io_service, and
+	// the client should outlive the io_service's run loop.
+	class Client : boost::noncopyable
+	{
+	public:
+		// Called for every reply packet. A streamed List gets several
+		// packets, all of them but the last one having "Status: Partial".
+		typedef std::function<void (const boost::system::error_code&, ParseResult&&)> ReplyHandler_t;
+
+		// Called for every "Status: Notify" packet pushed by the server
+		// for the subscriptions, and with an error once the subscribed
+		// connection is lost and the subscriptions should be renewed.
+		typedef ReplyHandler_t NotifyHandler_t;
+	private:
+		class Connection;
+		typedef std::shared_ptr<Connection> Connection_ptr;
+
+		boost::asio::io_service& m_io;
+		boost::asio::io_service::strand m_strand;
+		const ClientSettings m_settings;
+
+		std::vector<Connection_ptr> m_connections;
+		Connection_ptr m_subscribedConn;
+		NotifyHandler_t m_notifyHandler;
+		OpSummer m_summer;
+	public:
+		Client (boost::asio::io_service&, const ClientSettings&);
+		~Client ();
+
+		void enqueue (const Operation&);
+		void flush (const ReplyHandler_t&);
+
+		void send (const std::vector<Operation>&, const ReplyHandler_t&,
+				const HeaderFields_t& extraFields = HeaderFields_t ());
+
+		void setNotifyHandler (const NotifyHandler_t&);
+		void subscribe (const Operation&, const ReplyHandler_t&);
+
+		void close ();
+	private:
+		PacketGenerator makePacket (std::vector<Operation>&&, const HeaderFields_t&) const;
+		void doSend (std::vector<Operation>&&, const ReplyHandler_t&, const HeaderFields_t&);
+		Connection_ptr pickConnection ();
+	};
+}
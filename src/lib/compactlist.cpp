@@ -0,0 +1,217 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#include "compactlist.h"
+#include <stdexcept>
+#include <unordered_map>
+#include "operation.h"
+
+namespace Laretz
+{
+	namespace
+	{
+		const char FormatVersion = 1;
+		const FieldName CompactField = "compactList";
+
+		void PutVarint (std::string& out, uint64_t value)
+		{
+			while (value >= 0x80)
+			{
+				out.push_back (static_cast<char> ((value & 0x7f) | 0x80));
+				value >>= 7;
+			}
+			out.push_back (static_cast<char> (value));
+		}
+
+		void PutString (std::string& out, const std::string& str)
+		{
+			PutVarint (out, str.size ());
+			out += str;
+		}
+
+		class Reader
+		{
+			const std::string& m_data;
+			size_t m_pos;
+		public:
+			Reader (const std::string& data)
+			: m_data (data)
+			, m_pos (0)
+			{
+			}
+
+			char getByte ()
+			{
+				if (m_pos >= m_data.size ())
+					throw std::runtime_error ("truncated compact list");
+				return m_data [m_pos++];
+			}
+
+			uint64_t getVarint ()
+			{
+				uint64_t result = 0;
+				for (int shift = 0; shift < 64; shift += 7)
+				{
+					const auto byte = static_cast<unsigned char> (getByte ());
+					result |= static_cast<uint64_t> (byte & 0x7f) << shift;
+					if (!(byte & 0x80))
+						return result;
+				}
+				throw std::runtime_error ("malformed varint in compact list");
+			}
+
+			size_t remaining () const
+			{
+				return m_data.size () - m_pos;
+			}
+
+			std::string getString ()
+			{
+				const auto size = getVarint ();
+				if (size > m_data.size () - m_pos)
+					throw std::runtime_error ("truncated compact list");
+
+				const auto start = m_pos;
+				m_pos += size;
+				return m_data.substr (start, size);
+			}
+		};
+	}
+
+	std::string EncodeCompactList (const std::vector<Item>& items)
+	{
+		std::vector<const std::string*> dict;
+		std::unordered_map<std::string, uint64_t> dictIndex;
+		std::vector<uint64_t> parents;
+		parents.reserve (items.size ());
+		for (const auto& item : items)
+		{
+			const auto& parent = item.getParentId ();
+			auto pos = dictIndex.find (parent);
+			if (pos == dictIndex.end ())
+			{
+				pos = dictIndex.insert ({ parent, dict.size () }).first;
+				dict.push_back (&item.getParentId ());
+			}
+			parents.push_back (pos->second);
+		}
+
+		std::string out;
+		out.push_back (FormatVersion);
+		PutVarint (out, items.size ());
+
+		PutVarint (out, dict.size ());
+		for (const auto parent : dict)
+			PutString (out, *parent);
+
+		for (const auto index : parents)
+			PutVarint (out, index);
+
+		for (const auto& item : items)
+			PutString (out, item.getId ());
+
+		// Seqs mostly grow, so the deltas are small; zigzag keeps the
+		// occasional step back small as well.
+		uint64_t prev = 0;
+		for (const auto& item : items)
+		{
+			const auto delta = static_cast<int64_t> (item.getSeq () - prev);
+			PutVarint (out, (static_cast<uint64_t> (delta) << 1) ^ static_cast<uint64_t> (delta >> 63));
+			prev = item.getSeq ();
+		}
+
+		return out;
+	}
+
+	std::vector<Item> DecodeCompactList (const std::string& data)
+	{
+		Reader reader { data };
+		if (reader.getByte () != FormatVersion)
+			throw std::runtime_error ("unsupported compact list version");
+
+		const auto count = reader.getVarint ();
+		if (count > data.size ())
+			throw std::runtime_error ("malformed compact list");
+
+		// Every dictionary entry takes at least a byte for its length.
+		const auto dictSize = reader.getVarint ();
+		if (dictSize > reader.remaining ())
+			throw std::runtime_error ("malformed compact list");
+
+		std::vector<std::string> dict (dictSize);
+		for (auto& parent : dict)
+			parent = reader.getString ();
+
+		std::vector<Item> items (count);
+		for (auto& item : items)
+		{
+			const auto index = reader.getVarint ();
+			if (index >= dict.size ())
+				throw std::runtime_error ("malformed compact list");
+			item.setParentId (dict [index]);
+		}
+
+		for (auto& item : items)
+			item.setId (reader.getString ());
+
+		uint64_t prev = 0;
+		for (auto& item : items)
+		{
+			const auto zigzag = reader.getVarint ();
+			const auto delta = static_cast<int64_t> (zigzag >> 1) ^ -static_cast<int64_t> (zigzag & 1);
+			prev += delta;
+			item.setSeq (prev);
+		}
+
+		return items;
+	}
+
+	Operation MakeCompactList (const std::vector<Item>& items)
+	{
+		Item packed;
+		packed [CompactField] = EncodeCompactList (items);
+
+		std::vector<Item> wrapped;
+		wrapped.push_back (std::move (packed));
+		return { OpType::List, std::move (wrapped) };
+	}
+
+	bool ExpandCompactList (Operation& op)
+	{
+		if (op.getType () != OpType::List || op.getItems ().size () != 1)
+			return false;
+
+		const auto field = op.getItems ().front ().find (CompactField);
+		const auto data = field ? boost::get<std::string> (field) : nullptr;
+		if (!data)
+			return false;
+
+		op.setItems (DecodeCompactList (*data));
+		return true;
+	}
+}
@@ -0,0 +1,129 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#include "compression.h"
+#include <stdexcept>
+#include <zlib.h>
+
+namespace Laretz
+{
+	namespace
+	{
+		const size_t ChunkSize = 16 * 1024;
+
+		template<typename F>
+		std::string Pump (z_stream& stream, const std::string& input, F f, size_t maxOutput = 0)
+		{
+			stream.next_in = reinterpret_cast<Bytef*> (const_cast<char*> (input.data ()));
+			stream.avail_in = input.size ();
+
+			std::string result;
+			char buf [ChunkSize];
+			do
+			{
+				stream.next_out = reinterpret_cast<Bytef*> (buf);
+				stream.avail_out = ChunkSize;
+
+				const auto ret = f (&stream);
+				if (ret != Z_OK && ret != Z_BUF_ERROR && ret != Z_STREAM_END)
+					throw std::runtime_error ("zlib error " + std::to_string (ret));
+
+				result.append (buf, ChunkSize - stream.avail_out);
+				if (maxOutput && result.size () > maxOutput)
+					throw std::runtime_error ("decompressed data is too large");
+			} while (!stream.avail_out);
+
+			if (stream.avail_in)
+				throw std::runtime_error ("truncated compressed stream");
+
+			return result;
+		}
+	}
+
+	Deflater::Deflater (size_t threshold, int level)
+	: m_threshold (threshold)
+	, m_level (level)
+	{
+	}
+
+	Deflater::~Deflater ()
+	{
+		if (m_stream)
+			deflateEnd (m_stream.get ());
+	}
+
+	size_t Deflater::getThreshold () const
+	{
+		return m_threshold;
+	}
+
+	size_t Deflater::getBound (size_t size) const
+	{
+		// compressBound() is for a whole zlib stream, a sync flush adds
+		// an empty stored block on top of that.
+		return compressBound (size) + 6;
+	}
+
+	std::string Deflater::operator() (const std::string& data)
+	{
+		if (!m_stream)
+		{
+			std::unique_ptr<z_stream> stream (new z_stream ());
+			if (deflateInit (stream.get (), m_level) != Z_OK)
+				throw std::runtime_error ("unable to initialize deflater");
+			m_stream = std::move (stream);
+		}
+
+		return Pump (*m_stream, data, [] (z_stream *s) { return deflate (s, Z_SYNC_FLUSH); });
+	}
+
+	Inflater::Inflater (size_t maxOutput)
+	: m_maxOutput (maxOutput)
+	{
+	}
+
+	Inflater::~Inflater ()
+	{
+		if (m_stream)
+			inflateEnd (m_stream.get ());
+	}
+
+	std::string Inflater::operator() (const std::string& data)
+	{
+		if (!m_stream)
+		{
+			std::unique_ptr<z_stream> stream (new z_stream ());
+			if (inflateInit (stream.get ()) != Z_OK)
+				throw std::runtime_error ("unable to initialize inflater");
+			m_stream = std::move (stream);
+		}
+
+		return Pump (*m_stream, data, [] (z_stream *s) { return inflate (s, Z_SYNC_FLUSH); }, m_maxOutput);
+	}
+}
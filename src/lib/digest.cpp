@@ -0,0 +1,113 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#include "digest.h"
+
+namespace Laretz
+{
+	namespace
+	{
+		uint64_t Mix (uint64_t x)
+		{
+			x ^= x >> 30;
+			x *= 0xbf58476d1ce4e5b9ULL;
+			x ^= x >> 27;
+			x *= 0x94d049bb133111ebULL;
+			x ^= x >> 31;
+			return x;
+		}
+	}
+
+	uint64_t ItemDigest (const std::string& id, uint64_t seq)
+	{
+		uint64_t hash = 0xcbf29ce484222325ULL;
+		for (const auto c : id)
+		{
+			hash ^= static_cast<unsigned char> (c);
+			hash *= 0x100000001b3ULL;
+		}
+
+		return Mix (Mix (hash) ^ seq);
+	}
+
+	SubtreeDigest::SubtreeDigest ()
+	: SubtreeDigest (0, 0)
+	{
+	}
+
+	SubtreeDigest::SubtreeDigest (uint64_t digest, uint64_t count)
+	: m_digest (digest)
+	, m_count (count)
+	{
+	}
+
+	void SubtreeDigest::add (const std::string& id, uint64_t seq)
+	{
+		m_digest ^= ItemDigest (id, seq);
+		++m_count;
+	}
+
+	SubtreeDigest& SubtreeDigest::operator+= (const SubtreeDigest& other)
+	{
+		m_digest ^= other.m_digest;
+		m_count += other.m_count;
+		return *this;
+	}
+
+	SubtreeDigest& SubtreeDigest::operator-= (const SubtreeDigest& other)
+	{
+		m_digest ^= other.m_digest;
+		m_count -= other.m_count;
+		return *this;
+	}
+
+	bool SubtreeDigest::operator== (const SubtreeDigest& other) const
+	{
+		return m_digest == other.m_digest && m_count == other.m_count;
+	}
+
+	bool SubtreeDigest::operator!= (const SubtreeDigest& other) const
+	{
+		return !(*this == other);
+	}
+
+	SubtreeDigest DigestChange (const std::string& id, uint64_t oldSeq, uint64_t newSeq,
+			const SubtreeDigest& subtree)
+	{
+		SubtreeDigest change;
+		if (oldSeq)
+			change -= { ItemDigest (id, oldSeq), 1 };
+
+		if (newSeq)
+			change.add (id, newSeq);
+		else
+			change -= subtree;
+
+		return change;
+	}
+}
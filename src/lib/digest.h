@@ -0,0 +1,63 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+namespace Laretz
+{
+	uint64_t ItemDigest (const std::string& id, uint64_t seq);
+
+	// Order-independent digest of the (id, seq) pairs of a subtree: adding
+	// and removing an item are the same xor, so the server keeps these up
+	// to date without rescanning anything.
+	struct SubtreeDigest
+	{
+		uint64_t m_digest;
+		uint64_t m_count;
+
+		SubtreeDigest ();
+		SubtreeDigest (uint64_t digest, uint64_t count);
+
+		void add (const std::string& id, uint64_t seq);
+
+		SubtreeDigest& operator+= (const SubtreeDigest&);
+		SubtreeDigest& operator-= (const SubtreeDigest&);
+
+		bool operator== (const SubtreeDigest&) const;
+		bool operator!= (const SubtreeDigest&) const;
+	};
+
+	// What the digests of all the ancestors of an item change by when its
+	// seq goes from oldSeq to newSeq, zero standing for no item. A removed
+	// item takes its subtree along, as that isn't reachable anymore.
+	SubtreeDigest DigestChange (const std::string& id, uint64_t oldSeq, uint64_t newSeq,
+			const SubtreeDigest& subtree = SubtreeDigest ());
+}
@@ -0,0 +1,207 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#include "fieldname.h"
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+namespace Laretz
+{
+	namespace
+	{
+		typedef FieldName::Entry Entry;
+
+		const char *ProtocolNames [] =
+		{
+			"", "autoMerge", "blobs", "bodies", "cancel", "compact", "compactList",
+			"count", "cursor", "data", "digest", "field", "fields", "length", "limit",
+			"offset", "op", "size", "subtree", "uploadData", "uploadField",
+			"uploadFinal", "uploadId", "uploadOffset", "wait"
+		};
+
+		// Interned entries are never freed, so handles to them don't need to
+		// own anything. Every thread remembers the entries it has already
+		// seen, so the mutex is only taken for a name a thread hasn't used
+		// yet, and not at all once the table is full.
+		class Interner
+		{
+			std::mutex m_mutex;
+			std::unordered_map<std::string, Entry> m_entries;
+			std::atomic<bool> m_full;
+		public:
+			Interner ()
+			: m_full (false)
+			{
+				for (const auto name : ProtocolNames)
+					add (name);
+			}
+
+			void add (const std::string& name)
+			{
+				if (name.size () > FieldName::MaxInternedLength)
+					return;
+
+				std::lock_guard<std::mutex> guard { m_mutex };
+				findOrAdd (name);
+			}
+
+			std::shared_ptr<const Entry> intern (const std::string& name)
+			{
+				if (name.size () > FieldName::MaxInternedLength)
+					return MakePrivate (name);
+
+				thread_local std::unordered_map<std::string, const Entry*> cache;
+				const auto cachePos = cache.find (name);
+				if (cachePos != cache.end ())
+					return MakeShared (cachePos->second);
+
+				// A full table never changes again, so it can be read as is.
+				const Entry *entry = nullptr;
+				if (m_full.load (std::memory_order_acquire))
+				{
+					const auto pos = m_entries.find (name);
+					if (pos != m_entries.end ())
+						entry = &pos->second;
+				}
+				else
+				{
+					std::lock_guard<std::mutex> guard { m_mutex };
+					entry = findOrAdd (name);
+				}
+				if (!entry)
+					return MakePrivate (name);
+
+				cache [name] = entry;
+				return MakeShared (entry);
+			}
+		private:
+			// Adds the name if there's still room. Called with the mutex held.
+			const Entry* findOrAdd (const std::string& name)
+			{
+				const auto pos = m_entries.find (name);
+				if (pos != m_entries.end ())
+					return &pos->second;
+
+				if (m_entries.size () >= FieldName::MaxInternedNames)
+				{
+					m_full.store (true, std::memory_order_release);
+					return nullptr;
+				}
+
+				const Entry entry { name, std::hash<std::string> () (name), true };
+				return &m_entries.insert ({ name, entry }).first->second;
+			}
+
+			static std::shared_ptr<const Entry> MakeShared (const Entry *entry)
+			{
+				return std::shared_ptr<const Entry> (std::shared_ptr<const Entry> (), entry);
+			}
+
+			static std::shared_ptr<const Entry> MakePrivate (const std::string& name)
+			{
+				return std::make_shared<Entry> (Entry { name, std::hash<std::string> () (name), false });
+			}
+		};
+
+		Interner& GetInterner ()
+		{
+			static Interner interner;
+			return interner;
+		}
+
+		const std::shared_ptr<const Entry>& GetEmpty ()
+		{
+			static const auto empty = GetInterner ().intern (std::string ());
+			return empty;
+		}
+	}
+
+	FieldName::FieldName ()
+	: m_entry (GetEmpty ())
+	{
+	}
+
+	FieldName::FieldName (const std::string& name)
+	: m_entry (GetInterner ().intern (name))
+	{
+	}
+
+	FieldName::FieldName (const char *name)
+	: FieldName (std::string (name))
+	{
+	}
+
+	void FieldName::Intern (const std::string& name)
+	{
+		GetInterner ().add (name);
+	}
+
+	const std::string& FieldName::str () const
+	{
+		return m_entry->m_name;
+	}
+
+	FieldName::operator const std::string& () const
+	{
+		return m_entry->m_name;
+	}
+
+	size_t FieldName::getHash () const
+	{
+		return m_entry->m_hash;
+	}
+
+	bool FieldName::isInterned () const
+	{
+		return m_entry->m_interned;
+	}
+
+	bool FieldName::operator== (const FieldName& other) const
+	{
+		if (m_entry == other.m_entry)
+			return true;
+
+		if (m_entry->m_interned && other.m_entry->m_interned)
+			return false;
+
+		return m_entry->m_hash == other.m_entry->m_hash &&
+				m_entry->m_name == other.m_entry->m_name;
+	}
+
+	bool FieldName::operator!= (const FieldName& other) const
+	{
+		return !(*this == other);
+	}
+
+	bool FieldName::operator< (const FieldName& other) const
+	{
+		return m_entry != other.m_entry && m_entry->m_name < other.m_entry->m_name;
+	}
+}
@@ -0,0 +1,90 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <functional>
+
+namespace Laretz
+{
+	// Names are interned the first time they are seen, so comparing them
+	// for equality is a pointer compare. The table is bounded, so names
+	// coming from the network can't grow it forever: once it's full, any
+	// name not in it yet gets a private entry and is compared by value.
+	// Intern() puts a name there in advance, before the table fills up.
+	// Ordering always compares the names themselves.
+	class FieldName
+	{
+	public:
+		struct Entry
+		{
+			std::string m_name;
+			size_t m_hash;
+			bool m_interned;
+		};
+	private:
+		std::shared_ptr<const Entry> m_entry;
+	public:
+		enum InternLimits
+		{
+			MaxInternedLength = 128,
+			MaxInternedNames = 4096
+		};
+
+		FieldName ();
+		FieldName (const std::string&);
+		FieldName (const char*);
+
+		static void Intern (const std::string&);
+
+		const std::string& str () const;
+		operator const std::string& () const;
+
+		size_t getHash () const;
+		bool isInterned () const;
+
+		bool operator== (const FieldName&) const;
+		bool operator!= (const FieldName&) const;
+		bool operator< (const FieldName&) const;
+	};
+}
+
+namespace std
+{
+	template<>
+	struct hash<Laretz::FieldName>
+	{
+		size_t operator() (const Laretz::FieldName& name) const
+		{
+			return name.getHash ();
+		}
+	};
+}
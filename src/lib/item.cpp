@@ -27,10 +27,39 @@
  **********************************************************************/
 
 #include "item.h"
+#include <algorithm>
 #include <stdexcept>
 
 namespace Laretz
 {
+	namespace
+	{
+		const size_t LinearSearchLimit = 16;
+
+		template<typename It>
+		It LowerBound (It begin, It end, const FieldName& name)
+		{
+			return std::lower_bound (begin, end, name,
+					[] (const Item::value_type& field, const FieldName& name) { return field.first < name; });
+		}
+
+		template<typename It>
+		It Find (It begin, It end, const FieldName& name)
+		{
+			if (static_cast<size_t> (end - begin) <= LinearSearchLimit)
+				return std::find_if (begin, end,
+						[&name] (const Item::value_type& field) { return field.first == name; });
+
+			const auto pos = LowerBound (begin, end, name);
+			return pos == end || pos->first != name ? end : pos;
+		}
+
+		bool FieldLess (const Item::value_type& left, const Item::value_type& right)
+		{
+			return left.first < right.first;
+		}
+	}
+
 	Item::Item ()
 	: m_seq (0)
 	{
@@ -48,7 +77,28 @@ namespace Laretz
 	{
 	}
 
-	std::string Item::getId () const
+	Item::Item (const Item&) = default;
+
+	Item::Item (Item&& other) noexcept
+	: m_id (std::move (other.m_id))
+	, m_parentId (std::move (other.m_parentId))
+	, m_fields (std::move (other.m_fields))
+	, m_seq (other.m_seq)
+	{
+	}
+
+	Item& Item::operator= (const Item&) = default;
+
+	Item& Item::operator= (Item&& other) noexcept
+	{
+		m_id = std::move (other.m_id);
+		m_parentId = std::move (other.m_parentId);
+		m_fields = std::move (other.m_fields);
+		m_seq = other.m_seq;
+		return *this;
+	}
+
+	const std::string& Item::getId () const
 	{
 		return m_id;
 	}
@@ -58,7 +108,12 @@ namespace Laretz
 		m_id = id;
 	}
 
-	std::string Item::getParentId () const
+	void Item::setId (std::string&& id)
+	{
+		m_id = std::move (id);
+	}
+
+	const std::string& Item::getParentId () const
 	{
 		return m_parentId;
 	}
@@ -68,6 +123,11 @@ namespace Laretz
 		m_parentId = parentId;
 	}
 
+	void Item::setParentId (std::string&& parentId)
+	{
+		m_parentId = std::move (parentId);
+	}
+
 	uint64_t Item::getSeq () const
 	{
 		return m_seq;
@@ -78,15 +138,24 @@ namespace Laretz
 		m_seq = seq;
 	}
 
-	Field_t Item::operator[] (const std::string& name) const
+	Field_t Item::operator[] (const FieldName& name) const
+	{
+		const auto field = find (name);
+		return field ? *field : Field_t ();
+	}
+
+	Field_t& Item::operator[] (const FieldName& name)
 	{
-		const auto pos = m_fields.find (name);
-		return pos == m_fields.end () ? Field_t () : pos->second;
+		auto pos = Find (m_fields.begin (), m_fields.end (), name);
+		if (pos == m_fields.end ())
+			pos = m_fields.insert (LowerBound (m_fields.begin (), m_fields.end (), name), { name, Field_t () });
+		return pos->second;
 	}
 
-	Field_t& Item::operator[] (const std::string& name)
+	const Field_t* Item::find (const FieldName& name) const
 	{
-		return m_fields [name];
+		const auto pos = Find (m_fields.begin (), m_fields.end (), name);
+		return pos == m_fields.end () ? nullptr : &pos->second;
 	}
 
 	auto Item::begin () -> iterator
@@ -114,11 +183,55 @@ namespace Laretz
 		if (m_id != other.m_id)
 			throw std::logic_error ("two different items are being added");
 
+		auto pos = m_fields.begin ();
 		for (const auto& pair : other)
-			m_fields [pair.first] = pair.second;
+		{
+			pos = LowerBound (pos, m_fields.end (), pair.first);
+			if (pos != m_fields.end () && pos->first == pair.first)
+				pos->second = pair.second;
+			else
+				pos = m_fields.insert (pos, pair);
+			++pos;
+		}
+
+		m_seq = other.m_seq;
+
+		return *this;
+	}
+
+	Item& Item::operator+= (Item&& other)
+	{
+		if (m_id != other.m_id)
+			throw std::logic_error ("two different items are being added");
+
+		auto pos = m_fields.begin ();
+		for (auto& pair : other.m_fields)
+		{
+			pos = LowerBound (pos, m_fields.end (), pair.first);
+			if (pos != m_fields.end () && pos->first == pair.first)
+				pos->second = std::move (pair.second);
+			else
+				pos = m_fields.insert (pos, std::move (pair));
+			++pos;
+		}
 
 		m_seq = other.m_seq;
 
 		return *this;
 	}
+
+	void Item::normalizeFields ()
+	{
+		// Sorted input may still repeat a name, so only strictly ascending
+		// names are left as they are.
+		const auto notAscending = [] (const value_type& left, const value_type& right)
+				{ return !FieldLess (left, right); };
+		if (std::adjacent_find (m_fields.begin (), m_fields.end (), notAscending) == m_fields.end ())
+			return;
+
+		std::stable_sort (m_fields.begin (), m_fields.end (), FieldLess);
+		m_fields.erase (std::unique (m_fields.begin (), m_fields.end (),
+					[] (const value_type& left, const value_type& right) { return left.first == right.first; }),
+				m_fields.end ());
+	}
 }
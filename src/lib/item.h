@@ -28,51 +28,161 @@
 
 #pragma once
 
-#include <map>
 #include <string>
 #include <vector>
 #include <boost/variant.hpp>
+#include <boost/container/small_vector.hpp>
 #include <boost/serialization/access.hpp>
+#include <boost/serialization/collection_size_type.hpp>
+#include <boost/serialization/item_version_type.hpp>
+#include <boost/serialization/library_version_type.hpp>
+#include <boost/serialization/nvp.hpp>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/string.hpp>
+#include "blob.h"
+#include "fieldname.h"
 
 namespace Laretz
 {
-	typedef boost::variant<std::vector<char>,
+	typedef boost::variant<Blob,
 			std::string,
 			std::vector<std::string>,
 			int64_t,
-			double> Field_t;
+			double,
+			BlobRef> Field_t;
+
+	namespace detail
+	{
+		// The proxies below keep the field list in the same layout as the former
+		// std::map<std::string, Field_t>, so items stay compatible on the wire.
+		template<typename Entry>
+		class FieldEntryProxy
+		{
+			Entry& m_entry;
+
+			friend class boost::serialization::access;
+		public:
+			FieldEntryProxy (Entry& entry)
+			: m_entry (entry)
+			{
+			}
+		private:
+			template<typename Ar>
+			void save (Ar& ar, const unsigned int) const
+			{
+				ar << boost::serialization::make_nvp ("first", m_entry.first.str ());
+				ar << boost::serialization::make_nvp ("second", m_entry.second);
+			}
+
+			template<typename Ar>
+			void load (Ar& ar, const unsigned int)
+			{
+				std::string name;
+				ar >> boost::serialization::make_nvp ("first", name);
+				m_entry.first = name;
+				ar >> boost::serialization::make_nvp ("second", m_entry.second);
+			}
+
+			BOOST_SERIALIZATION_SPLIT_MEMBER ()
+		};
+
+		template<typename List>
+		class FieldListProxy
+		{
+			List& m_list;
+
+			friend class boost::serialization::access;
+		public:
+			FieldListProxy (List& list)
+			: m_list (list)
+			{
+			}
+		private:
+			template<typename Ar>
+			void save (Ar& ar, const unsigned int) const
+			{
+				using namespace boost::serialization;
+
+				const collection_size_type count (m_list.size ());
+				ar << BOOST_SERIALIZATION_NVP (count);
+
+				const item_version_type item_version (0);
+				ar << BOOST_SERIALIZATION_NVP (item_version);
+
+				for (const auto& entry : m_list)
+				{
+					const FieldEntryProxy<const typename List::value_type> proxy (entry);
+					ar << make_nvp ("item", proxy);
+				}
+			}
+
+			template<typename Ar>
+			void load (Ar& ar, const unsigned int)
+			{
+				using namespace boost::serialization;
+
+				collection_size_type count;
+				ar >> BOOST_SERIALIZATION_NVP (count);
+
+				item_version_type item_version (0);
+				if (library_version_type (3) < ar.get_library_version ())
+					ar >> BOOST_SERIALIZATION_NVP (item_version);
+
+				m_list.clear ();
+				m_list.resize (count);
+				for (auto& entry : m_list)
+				{
+					FieldEntryProxy<typename List::value_type> proxy (entry);
+					ar >> make_nvp ("item", proxy);
+				}
+			}
+
+			BOOST_SERIALIZATION_SPLIT_MEMBER ()
+		};
+	}
 
 	class Item
 	{
 		std::string m_id;
 		std::string m_parentId;
 
-		typedef std::map<std::string, Field_t> FieldMap_t;
-		FieldMap_t m_fields;
+		typedef std::pair<FieldName, Field_t> FieldEntry_t;
+		typedef boost::container::small_vector<FieldEntry_t, 8> FieldList_t;
+		FieldList_t m_fields;
 
 		uint64_t m_seq;
 
 		friend class boost::serialization::access;
 	public:
-		typedef FieldMap_t::iterator iterator;
-		typedef FieldMap_t::const_iterator const_iterator;
-		typedef FieldMap_t::value_type value_type;
+		typedef FieldList_t::iterator iterator;
+		typedef FieldList_t::const_iterator const_iterator;
+		typedef FieldList_t::value_type value_type;
 
 		Item ();
 		Item (const std::string& id, uint64_t seq);
 		Item (const std::string& id, const std::string& parentId, uint64_t seq);
 
-		std::string getId () const;
+		// Moves are declared noexcept so that vectors of items move them
+		// instead of copying when they grow.
+		Item (const Item&);
+		Item (Item&&) noexcept;
+		Item& operator= (const Item&);
+		Item& operator= (Item&&) noexcept;
+
+		const std::string& getId () const;
 		void setId (const std::string&);
+		void setId (std::string&&);
 
-		std::string getParentId () const;
+		const std::string& getParentId () const;
 		void setParentId (const std::string&);
+		void setParentId (std::string&&);
 
 		uint64_t getSeq () const;
 		void setSeq (uint64_t);
 
-		Field_t operator[] (const std::string&) const;
-		Field_t& operator[] (const std::string&);
+		Field_t operator[] (const FieldName&) const;
+		Field_t& operator[] (const FieldName&);
+		const Field_t* find (const FieldName&) const;
 
 		iterator begin ();
 		const_iterator begin () const;
@@ -80,14 +190,32 @@ namespace Laretz
 		const_iterator end () const;
 
 		Item& operator+= (const Item&);
+		Item& operator+= (Item&&);
 	private:
 		template<typename Ar>
-		void serialize (Ar& ar, const size_t)
+		void save (Ar& ar, const size_t) const
+		{
+			ar << m_id;
+			ar << m_parentId;
+			const detail::FieldListProxy<const FieldList_t> fields (m_fields);
+			ar << fields;
+			ar << m_seq;
+		}
+
+		template<typename Ar>
+		void load (Ar& ar, const size_t)
 		{
-			ar & m_id;
-			ar & m_parentId;
-			ar & m_fields;
-			ar & m_seq;
+			ar >> m_id;
+			ar >> m_parentId;
+			detail::FieldListProxy<FieldList_t> fields (m_fields);
+			ar >> fields;
+			ar >> m_seq;
+
+			normalizeFields ();
 		}
+
+		void normalizeFields ();
+
+		BOOST_SERIALIZATION_SPLIT_MEMBER ()
 	};
 }
@@ -0,0 +1,110 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#include "journal.h"
+#include <sstream>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/vector.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/variant.hpp>
+#include "operation.h"
+#include "opsummer.h"
+
+namespace Laretz
+{
+	namespace
+	{
+		std::string Serialize (const Operation& op)
+		{
+			std::ostringstream ostr;
+			boost::archive::binary_oarchive oar (ostr, boost::archive::no_header);
+			oar << op;
+			return ostr.str ();
+		}
+
+		Operation Deserialize (const char *data, size_t length)
+		{
+			std::istringstream istr (std::string (data, length));
+			boost::archive::binary_iarchive iar (istr, boost::archive::no_header);
+
+			Operation op;
+			iar >> op;
+			return op;
+		}
+	}
+
+	Journal::Journal (const std::string& path)
+	: m_log (path, "LRZJ", 1)
+	{
+	}
+
+	void Journal::append (const Operation& op)
+	{
+		m_log.append (Serialize (op));
+	}
+
+	std::vector<Operation> Journal::replay () const
+	{
+		std::vector<Operation> result;
+		result.reserve (m_log.getRecordsCount ());
+		m_log.forEach ([&result] (size_t, const char *data, size_t length)
+				{ result.push_back (Deserialize (data, length)); });
+		return result;
+	}
+
+	void Journal::compact ()
+	{
+		OpSummer summer;
+		m_log.forEach ([&summer] (size_t, const char *data, size_t length)
+				{ summer += Deserialize (data, length); });
+
+		const auto& ops = summer.takeOps ();
+		m_log.rewrite ([&ops] (RecordLog& log)
+				{
+					for (const auto& op : ops)
+						log.append (Serialize (op));
+				});
+	}
+
+	void Journal::clear ()
+	{
+		m_log.clear ();
+	}
+
+	size_t Journal::getRecordsCount () const
+	{
+		return m_log.getRecordsCount ();
+	}
+
+	size_t Journal::getUsedSize () const
+	{
+		return m_log.getUsedSize ();
+	}
+}
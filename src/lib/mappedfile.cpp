@@ -0,0 +1,167 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#include "mappedfile.h"
+#include <system_error>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace Laretz
+{
+	namespace
+	{
+		void ThrowErrno (const std::string& what, const std::string& path)
+		{
+			throw std::system_error (errno, std::system_category (), what + " " + path);
+		}
+
+		std::string GetDirectory (const std::string& path)
+		{
+			const auto pos = path.rfind ('/');
+			if (pos == std::string::npos)
+				return ".";
+			return pos ? path.substr (0, pos) : "/";
+		}
+	}
+
+	MappedFile::MappedFile (const std::string& path, size_t minSize)
+	: m_path (path)
+	, m_fd (::open (path.c_str (), O_RDWR | O_CREAT, 0600))
+	, m_data (nullptr)
+	, m_size (0)
+	{
+		if (m_fd < 0)
+			ThrowErrno ("cannot open", path);
+
+		struct stat st;
+		if (::fstat (m_fd, &st))
+		{
+			::close (m_fd);
+			ThrowErrno ("cannot stat", path);
+		}
+
+		m_size = static_cast<size_t> (st.st_size);
+		try
+		{
+			if (m_size < minSize)
+				resize (minSize);
+			else
+				map ();
+		}
+		catch (...)
+		{
+			unmap ();
+			::close (m_fd);
+			throw;
+		}
+	}
+
+	MappedFile::~MappedFile ()
+	{
+		unmap ();
+		::close (m_fd);
+	}
+
+	const std::string& MappedFile::getPath () const
+	{
+		return m_path;
+	}
+
+	char* MappedFile::data ()
+	{
+		return m_data;
+	}
+
+	const char* MappedFile::data () const
+	{
+		return m_data;
+	}
+
+	size_t MappedFile::size () const
+	{
+		return m_size;
+	}
+
+	void MappedFile::resize (size_t size)
+	{
+		unmap ();
+
+		if (::ftruncate (m_fd, static_cast<off_t> (size)))
+			ThrowErrno ("cannot resize", m_path);
+
+		m_size = size;
+		map ();
+	}
+
+	void MappedFile::sync (size_t offset, size_t length)
+	{
+		if (!length)
+			return;
+
+		const size_t pageSize = ::sysconf (_SC_PAGESIZE);
+		const auto begin = offset / pageSize * pageSize;
+		if (::msync (m_data + begin, offset + length - begin, MS_SYNC))
+			ThrowErrno ("cannot sync", m_path);
+	}
+
+	void MappedFile::replace (const std::string& from, const std::string& to)
+	{
+		if (std::rename (from.c_str (), to.c_str ()))
+			ThrowErrno ("cannot rename", from);
+
+		const auto dirFd = ::open (GetDirectory (to).c_str (), O_RDONLY);
+		if (dirFd < 0)
+			return;
+		::fsync (dirFd);
+		::close (dirFd);
+	}
+
+	void MappedFile::map ()
+	{
+		if (!m_size)
+			return;
+
+		const auto data = ::mmap (nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+		if (data == MAP_FAILED)
+			ThrowErrno ("cannot map", m_path);
+
+		m_data = static_cast<char*> (data);
+	}
+
+	void MappedFile::unmap ()
+	{
+		if (m_data)
+			::munmap (m_data, m_size);
+		m_data = nullptr;
+	}
+}
@@ -33,13 +33,60 @@ namespace Laretz
 {
 	Operation::Operation ()
 	: m_type (OpType::Modify)
+	, m_idIndexValid (false)
 	{
 	}
 
 	Operation::Operation (OpType op, const std::vector<Item>& items)
 	: m_type (op)
 	, m_items (items)
+	, m_idIndexValid (false)
 	{
+		rebuildIdIndex ();
+	}
+
+	Operation::Operation (OpType op, std::vector<Item>&& items)
+	: m_type (op)
+	, m_items (std::move (items))
+	, m_idIndexValid (false)
+	{
+		rebuildIdIndex ();
+	}
+
+	Operation::Operation (const Operation& other)
+	: m_type (other.m_type)
+	, m_items (other.m_items)
+	, m_idIndex (other.m_idIndex)
+	, m_idIndexValid (other.m_idIndexValid)
+	{
+	}
+
+	Operation::Operation (Operation&& other)
+	: m_type (other.m_type)
+	, m_items (std::move (other.m_items))
+	, m_idIndex (std::move (other.m_idIndex))
+	, m_idIndexValid (other.m_idIndexValid)
+	{
+		other.invalidateIdIndex ();
+	}
+
+	Operation& Operation::operator= (const Operation& other)
+	{
+		m_type = other.m_type;
+		m_items = other.m_items;
+		m_idIndex = other.m_idIndex;
+		m_idIndexValid = other.m_idIndexValid;
+		return *this;
+	}
+
+	Operation& Operation::operator= (Operation&& other)
+	{
+		m_type = other.m_type;
+		m_items = std::move (other.m_items);
+		m_idIndex = std::move (other.m_idIndex);
+		m_idIndexValid = other.m_idIndexValid;
+		other.invalidateIdIndex ();
+		return *this;
 	}
 
 	OpType Operation::getType () const
@@ -59,12 +106,20 @@ namespace Laretz
 
 	std::vector<Item>& Operation::getItems()
 	{
+		invalidateIdIndex ();
 		return m_items;
 	}
 
-	void Operation::setItems (const std::vector<Item>& item)
+	void Operation::setItems (const std::vector<Item>& items)
 	{
-		m_items = item;
+		m_items = items;
+		rebuildIdIndex ();
+	}
+
+	void Operation::setItems (std::vector<Item>&& items)
+	{
+		m_items = std::move (items);
+		rebuildIdIndex ();
 	}
 
 	bool Operation::empty () const
@@ -74,32 +129,67 @@ namespace Laretz
 
 	bool Operation::contains (const std::string& id) const
 	{
-		return std::find_if (m_items.begin (), m_items.end (),
-				[&id] (const Item& item) { return item.getId () == id; }) != m_items.end ();
+		if (m_idIndexValid)
+			return m_idIndex.count (id);
+
+		return std::any_of (m_items.begin (), m_items.end (),
+				[&id] (const Item& item) { return item.getId () == id; });
 	}
 
 	Operation& Operation::operator+= (const Item& item)
 	{
-		const auto pos = std::find_if (m_items.begin (), m_items.end (),
-				[&item] (const Item& it) { return it.getId () == item.getId (); });
-		if (pos == m_items.end ())
+		auto& index = getIdIndex ();
+		const auto pos = index.find (item.getId ());
+		if (pos == index.end ())
+		{
+			index.emplace (item.getId (), m_items.size ());
 			m_items.push_back (item);
+		}
 		else
-			*pos += item;
+			m_items [pos->second] += item;
 
 		return *this;
 	}
 
-	bool Operation::operator-= (const Item& item)
+	Operation& Operation::operator+= (Item&& item)
 	{
-		const auto pos = std::find_if (m_items.begin (), m_items.end (),
-				[&item] (const Item& it) { return it.getId () == item.getId (); });
+		auto& index = getIdIndex ();
+		const auto pos = index.find (item.getId ());
+		if (pos == index.end ())
+		{
+			index.emplace (item.getId (), m_items.size ());
+			m_items.push_back (std::move (item));
+		}
+		else
+			m_items [pos->second] += std::move (item);
 
-		const bool del = pos != m_items.end ();
-		if (del)
-			m_items.erase (pos);
+		return *this;
+	}
 
-		return del;
+	bool Operation::operator-= (const Item& item)
+	{
+		auto& index = getIdIndex ();
+		const auto pos = index.find (item.getId ());
+		if (pos == index.end ())
+			return false;
+
+		const auto removed = pos->second;
+		m_items.erase (m_items.begin () + removed);
+
+		for (auto& entry : index)
+			if (entry.second > removed)
+				--entry.second;
+
+		const auto dup = index.size () > m_items.size () ?
+				m_items.end () :
+				std::find_if (m_items.begin () + removed, m_items.end (),
+						[&pos] (const Item& it) { return it.getId () == pos->first; });
+		if (dup == m_items.end ())
+			index.erase (pos);
+		else
+			pos->second = dup - m_items.begin ();
+
+		return true;
 	}
 
 	Operation& Operation::operator+= (const Operation& op)
@@ -109,4 +199,35 @@ namespace Laretz
 
 		return *this;
 	}
+
+	Operation& Operation::operator+= (Operation&& op)
+	{
+		for (auto& item : op.m_items)
+			*this += std::move (item);
+
+		return *this;
+	}
+
+	auto Operation::getIdIndex () -> IdIndex_t&
+	{
+		if (!m_idIndexValid)
+			rebuildIdIndex ();
+
+		return m_idIndex;
+	}
+
+	void Operation::rebuildIdIndex ()
+	{
+		m_idIndex.clear ();
+		m_idIndex.reserve (m_items.size ());
+		for (size_t i = 0; i < m_items.size (); ++i)
+			m_idIndex.emplace (m_items [i].getId (), i);
+		m_idIndexValid = true;
+	}
+
+	void Operation::invalidateIdIndex ()
+	{
+		m_idIndex.clear ();
+		m_idIndexValid = false;
+	}
 }
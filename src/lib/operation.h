@@ -28,6 +28,7 @@
 
 #pragma once
 
+#include <unordered_map>
 #include <boost/serialization/access.hpp>
 #include "item.h"
 
@@ -44,7 +45,17 @@ namespace Laretz
 		Fetch,
 
 		// Only replies
-		Refetch
+		Refetch,
+
+		// Blob transfer requests
+		FetchBlob,
+		UploadBlob,
+
+		// Change notifications
+		Subscribe,
+
+		// Subtree digests for sync verification
+		Digest
 	};
 
 	enum ErrorCode
@@ -60,10 +71,23 @@ namespace Laretz
 
 		std::vector<Item> m_items;
 
+		typedef std::unordered_map<std::string, size_t> IdIndex_t;
+		// Kept up to date by everything that sets items. Handing out the
+		// items for modification drops it until the next non-const call.
+		IdIndex_t m_idIndex;
+		bool m_idIndexValid;
+
 		friend class boost::serialization::access;
 	public:
 		Operation ();
 		Operation (OpType op, const std::vector<Item>& items);
+		Operation (OpType op, std::vector<Item>&& items);
+
+		Operation (const Operation&);
+		Operation (Operation&&);
+
+		Operation& operator= (const Operation&);
+		Operation& operator= (Operation&&);
 
 		OpType getType () const;
 		void setType (OpType);
@@ -71,20 +95,30 @@ namespace Laretz
 		const std::vector<Item>& getItems () const;
 		std::vector<Item>& getItems ();
 		void setItems (const std::vector<Item>&);
+		void setItems (std::vector<Item>&&);
 
 		bool empty () const;
 		bool contains (const std::string&) const;
 
 		Operation& operator+= (const Item&);
+		Operation& operator+= (Item&&);
 		bool operator-= (const Item&);
 
 		Operation& operator+= (const Operation&);
+		Operation& operator+= (Operation&&);
 	private:
+		IdIndex_t& getIdIndex ();
+		void rebuildIdIndex ();
+		void invalidateIdIndex ();
+
 		template<typename Ar>
 		void serialize (Ar& ar, const size_t)
 		{
 			ar & m_type;
 			ar & m_items;
+
+			if (Ar::is_loading::value)
+				rebuildIdIndex ();
 		}
 	};
 }
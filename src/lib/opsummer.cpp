@@ -27,37 +27,57 @@
  **********************************************************************/
 
 #include "opsummer.h"
+#include <algorithm>
 #include <stdexcept>
-#include <unordered_set>
 #include "item.h"
 
 namespace Laretz
 {
+	OpSummer::OpSummer ()
+	: m_nextOrder (0)
+	, m_opsValid (true)
+	{
+	}
+
 	OpSummer& OpSummer::operator+= (const Operation& op)
 	{
+		return *this += Operation (op);
+	}
+
+	OpSummer& OpSummer::operator+= (Operation&& op)
+	{
+		m_opsValid = false;
+
 		switch (op.getType ())
 		{
 		case OpType::Append:
-			m_ops.push_back (op);
+			for (auto& item : op.getItems ())
+				append (std::move (item));
 			break;
 		case OpType::Delete:
-			mergeDeleted (op);
+			for (auto& item : op.getItems ())
+				remove (std::move (item));
 			break;
 		case OpType::Modify:
-			mergeModified (op);
+			for (auto& item : op.getItems ())
+				modify (std::move (item));
 			break;
 		case OpType::List:
 		case OpType::Fetch:
 		case OpType::Refetch:
-			if (!m_ops.empty () &&
-					m_ops.front ().getType () != op.getType ())
+		case OpType::FetchBlob:
+		case OpType::Digest:
+			if (m_readOp && m_readOp->getType () != op.getType ())
 				throw std::runtime_error ("Cannot merge different readonly operations");
 
-			if (m_ops.empty ())
-				m_ops.push_back (op);
+			if (!m_readOp)
+				m_readOp = std::move (op);
 			else
-				m_ops.front () += op;
+				*m_readOp += std::move (op);
 			break;
+		case OpType::UploadBlob:
+		case OpType::Subscribe:
+			throw std::runtime_error ("Blob uploads and subscriptions cannot be merged and should be sent as is");
 		}
 
 		return *this;
@@ -65,66 +85,137 @@ namespace Laretz
 
 	const std::vector<Operation>& OpSummer::getOps () const
 	{
+		if (!m_opsValid)
+		{
+			m_ops = materialize (m_entries, [] (const Entry& entry) -> const Item& { return entry.m_item; });
+			if (m_readOp)
+				m_ops.insert (m_ops.begin (), *m_readOp);
+			m_opsValid = true;
+		}
+
 		return m_ops;
 	}
 
-	void OpSummer::mergeModified (Operation toAdd)
+	std::vector<Operation> OpSummer::takeOps ()
 	{
-		std::unordered_set<std::string> addedIds;
-		std::unordered_set<std::string> deletedIds;
+		std::vector<Operation> ops;
+		if (m_opsValid)
+			ops = std::move (m_ops);
+		else
+		{
+			ops = materialize (m_entries, [] (Entry& entry) -> Item&& { return std::move (entry.m_item); });
+			if (m_readOp)
+				ops.insert (ops.begin (), std::move (*m_readOp));
+		}
 
-		for (auto& op : m_ops)
+		m_entries.clear ();
+		m_readOp.reset ();
+		m_ops.clear ();
+		m_opsValid = true;
+
+		return ops;
+	}
+
+	void OpSummer::append (Item&& item)
+	{
+		const auto pos = m_entries.find (item.getId ());
+		if (pos == m_entries.end ())
 		{
-			switch (op.getType ())
-			{
-			case OpType::Append:
-				for (const auto& item : op.getItems ())
-					addedIds.insert (item.getId ());
-
-				for (const auto& item : toAdd.getItems ())
-					if (op.contains (item.getId ()))
-					{
-						op += item;
-						toAdd -= item;
-					}
-				break;
-			case OpType::Delete:
-				for (const auto& item : op.getItems ())
-					deletedIds.insert (item.getId ());
-				break;
-			case OpType::Modify:
-				for (const auto& item : toAdd.getItems ())
-					if (deletedIds.find (item.getId ()) == deletedIds.end ())
-					{
-						op += item;
-						toAdd -= item;
-					}
-				break;
-			default:
-				break;
-			}
+			auto id = item.getId ();
+			m_entries.emplace (std::move (id), Entry { ItemState::Appended, std::move (item), m_nextOrder++ });
+			return;
 		}
 
-		if (!toAdd.empty ())
-			m_ops.push_back (toAdd);
+		auto& entry = pos->second;
+		if (entry.m_state == ItemState::Deleted)
+		{
+			entry.m_state = ItemState::Replaced;
+			entry.m_item = std::move (item);
+		}
+		else
+			entry.m_item += std::move (item);
 	}
 
-	void OpSummer::mergeDeleted (Operation toDelete)
+	void OpSummer::modify (Item&& item)
 	{
-		const auto srcOp = toDelete;
+		const auto pos = m_entries.find (item.getId ());
+		if (pos == m_entries.end ())
+		{
+			auto id = item.getId ();
+			m_entries.emplace (std::move (id), Entry { ItemState::Modified, std::move (item), m_nextOrder++ });
+			return;
+		}
 
-		for (auto& op : m_ops)
+		auto& entry = pos->second;
+		if (entry.m_state != ItemState::Deleted)
+			entry.m_item += std::move (item);
+	}
+
+	void OpSummer::remove (Item&& item)
+	{
+		const auto pos = m_entries.find (item.getId ());
+		if (pos == m_entries.end ())
 		{
-			if (op.getType () == OpType::Delete)
-				continue;
+			auto id = item.getId ();
+			m_entries.emplace (std::move (id), Entry { ItemState::Deleted, std::move (item), m_nextOrder++ });
+			return;
+		}
 
-			const auto items = op.getItems ();
-			for (const auto& item : items)
-				if ((op -= item) && op.getType () == OpType::Append)
-					toDelete -= item;
+		auto& entry = pos->second;
+		switch (entry.m_state)
+		{
+		case ItemState::Appended:
+			m_entries.erase (pos);
+			break;
+		case ItemState::Modified:
+		case ItemState::Replaced:
+			entry.m_state = ItemState::Deleted;
+			entry.m_item = std::move (item);
+			break;
+		case ItemState::Deleted:
+			break;
 		}
+	}
+
+	template<typename Entries, typename ItemGetter>
+	std::vector<Operation> OpSummer::materialize (Entries& map, ItemGetter getter)
+	{
+		typedef decltype (&map.begin ()->second) EntryPtr_t;
+
+		std::vector<EntryPtr_t> entries;
+		entries.reserve (map.size ());
+		for (auto& pair : map)
+			entries.push_back (&pair.second);
+		std::sort (entries.begin (), entries.end (),
+				[] (EntryPtr_t left, EntryPtr_t right) { return left->m_order < right->m_order; });
+
+		Operation replaced { OpType::Delete, std::vector<Item> () };
+		Operation appended { OpType::Append, std::vector<Item> () };
+		Operation modified { OpType::Modify, std::vector<Item> () };
+		Operation deleted { OpType::Delete, std::vector<Item> () };
+
+		for (const auto entry : entries)
+			switch (entry->m_state)
+			{
+			case ItemState::Appended:
+				appended.getItems ().push_back (getter (*entry));
+				break;
+			case ItemState::Modified:
+				modified.getItems ().push_back (getter (*entry));
+				break;
+			case ItemState::Deleted:
+				deleted.getItems ().push_back (getter (*entry));
+				break;
+			case ItemState::Replaced:
+				replaced.getItems ().push_back ({ entry->m_item.getId (), entry->m_item.getSeq () });
+				appended.getItems ().push_back (getter (*entry));
+				break;
+			}
 
-		if (!toDelete.empty ())
-			m_ops.push_back (toDelete);
+		std::vector<Operation> result;
+		for (auto op : { &replaced, &appended, &modified, &deleted })
+			if (!op->empty ())
+				result.push_back (std::move (*op));
+		return result;
 	}
 }
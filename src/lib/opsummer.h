@@ -28,19 +28,50 @@
 
 #pragma once
 
+#include <unordered_map>
+#include <boost/optional.hpp>
 #include "operation.h"
 
 namespace Laretz
 {
 	class OpSummer
 	{
-		std::vector<Operation> m_ops;
+		enum class ItemState
+		{
+			Appended,
+			Modified,
+			Deleted,
+			Replaced
+		};
+
+		struct Entry
+		{
+			ItemState m_state;
+			Item m_item;
+			uint64_t m_order;
+		};
+
+		std::unordered_map<std::string, Entry> m_entries;
+		uint64_t m_nextOrder;
+
+		boost::optional<Operation> m_readOp;
+
+		mutable std::vector<Operation> m_ops;
+		mutable bool m_opsValid;
 	public:
+		OpSummer ();
+
 		OpSummer& operator+= (const Operation&);
+		OpSummer& operator+= (Operation&&);
 
 		const std::vector<Operation>& getOps () const;
+		std::vector<Operation> takeOps ();
 	private:
-		void mergeModified (Operation);
-		void mergeDeleted (Operation);
+		void append (Item&&);
+		void modify (Item&&);
+		void remove (Item&&);
+
+		template<typename Entries, typename ItemGetter>
+		static std::vector<Operation> materialize (Entries&, ItemGetter);
 	};
 }
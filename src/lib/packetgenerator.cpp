@@ -27,21 +27,50 @@
  **********************************************************************/
 
 #include "packetgenerator.h"
+#include <limits>
+#include <algorithm>
 #include <boost/archive/text_oarchive.hpp>
-#include <boost/serialization/map.hpp>
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/string.hpp>
 #include <boost/serialization/variant.hpp>
 #include "operation.h"
+#include "compression.h"
 
 namespace Laretz
 {
+	namespace
+	{
+		std::string SerializeOps (const std::vector<Operation>& ops)
+		{
+			std::ostringstream arOstr;
+			boost::archive::text_oarchive oars (arOstr);
+			oars << ops;
+			return arOstr.str ();
+		}
+
+		std::string FormatPacket (const std::map<std::string, std::string>& fields,
+				const std::string& opsStr, const std::string& encoding = std::string ())
+		{
+			std::ostringstream ostr;
+			ostr << "Length: " << opsStr.size () << "\n";
+			if (!encoding.empty ())
+				ostr << "Content-Encoding: " << encoding << "\n";
+			for (const auto& field : fields)
+				ostr << field.first << ": " << field.second << "\n";
+			ostr << "\n";
+
+			ostr << opsStr;
+
+			return ostr.str ();
+		}
+	}
+
 	PacketGenerator::PacketGenerator ()
 	{
 	}
 
 	PacketGenerator::PacketGenerator (std::map<std::string, std::string>&& map)
-	: m_fields (map)
+	: m_fields (std::move (map))
 	{
 	}
 
@@ -57,27 +86,62 @@ namespace Laretz
 		return *this;
 	}
 
+	PacketGenerator& PacketGenerator::operator() (Operation&& op)
+	{
+		m_operations.push_back (std::move (op));
+		return *this;
+	}
+
 	PacketGenerator& PacketGenerator::operator[] (const std::vector<Operation>& ops)
 	{
 		std::copy (ops.begin (), ops.end (), std::back_inserter (m_operations));
 		return *this;
 	}
 
+	PacketGenerator& PacketGenerator::operator[] (std::vector<Operation>&& ops)
+	{
+		if (m_operations.empty ())
+			m_operations = std::move (ops);
+		else
+			std::move (ops.begin (), ops.end (), std::back_inserter (m_operations));
+		return *this;
+	}
+
 	std::string PacketGenerator::operator() () const
 	{
-		std::ostringstream arOstr;
-		boost::archive::text_oarchive oars (arOstr);
-		oars << m_operations;
-		const auto& opsStr = arOstr.str ();
+		return (*this) (serialize ());
+	}
+
+	std::string PacketGenerator::operator() (Deflater& deflater) const
+	{
+		return (*this) (serialize (), deflater);
+	}
+
+	std::string PacketGenerator::serialize () const
+	{
+		return SerializeOps (m_operations);
+	}
 
-		std::ostringstream ostr;
-		ostr << "Length: " << opsStr.size () << "\n";
+	size_t PacketGenerator::getSizeBound (const std::string& serialized, const Deflater& deflater) const
+	{
+		size_t result = std::string ("Length: \nContent-Encoding: deflate\n\n").size () +
+				std::numeric_limits<size_t>::digits10 + 1;
 		for (const auto& field : m_fields)
-			ostr << field.first << ": " << field.second << "\n";
-		ostr << "\n";
+			result += field.first.size () + field.second.size () + 3;
+
+		return result + std::max (serialized.size (), deflater.getBound (serialized.size ()));
+	}
 
-		ostr << opsStr;
+	std::string PacketGenerator::operator() (const std::string& serialized) const
+	{
+		return FormatPacket (m_fields, serialized);
+	}
+
+	std::string PacketGenerator::operator() (const std::string& serialized, Deflater& deflater) const
+	{
+		if (serialized.size () < deflater.getThreshold ())
+			return FormatPacket (m_fields, serialized);
 
-		return ostr.str ();
+		return FormatPacket (m_fields, deflater (serialized), "deflate");
 	}
 }
@@ -36,6 +36,7 @@
 namespace Laretz
 {
 	class Operation;
+	class Deflater;
 
 	class PacketGenerator
 	{
@@ -47,7 +48,17 @@ namespace Laretz
 
 		PacketGenerator& operator() (const std::pair<std::string, std::string>& field);
 		PacketGenerator& operator() (const Operation& op);
+		PacketGenerator& operator() (Operation&& op);
 		PacketGenerator& operator[] (const std::vector<Operation>& ops);
+		PacketGenerator& operator[] (std::vector<Operation>&& ops);
 		std::string operator() () const;
+		std::string operator() (Deflater&) const;
+
+		// Serializes the operations separately from formatting the packet,
+		// so that its size is known before anything goes to a deflater.
+		std::string serialize () const;
+		size_t getSizeBound (const std::string& serialized, const Deflater&) const;
+		std::string operator() (const std::string& serialized) const;
+		std::string operator() (const std::string& serialized, Deflater&) const;
 	};
 }
@@ -28,12 +28,14 @@
 
 #include "packetparser.h"
 #include <sstream>
+#include <iterator>
+#include <stdexcept>
 #include <boost/algorithm/string.hpp>
 #include <boost/archive/text_iarchive.hpp>
-#include <boost/serialization/map.hpp>
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/string.hpp>
 #include <boost/serialization/variant.hpp>
+#include "compression.h"
 
 namespace Laretz
 {
@@ -50,19 +52,31 @@ namespace Laretz
 				if (field.empty ())
 					break;
 
-				std::vector<std::string> splitVec;
-				boost::split (splitVec, field, boost::is_any_of (":"));
-				for (auto& str : splitVec)
-					boost::trim (str);
-
-				if (splitVec.size () != 2)
+				// Values may contain colons themselves (like multi-root
+				// cursors), so only the first one separates the name.
+				const auto colonPos = field.find (':');
+				if (colonPos == std::string::npos)
 					continue;
 
-				fields.insert ({ splitVec [0], splitVec [1] });
+				auto name = field.substr (0, colonPos);
+				auto value = field.substr (colonPos + 1);
+				boost::trim (name);
+				boost::trim (value);
+
+				fields.insert ({ name, value });
 			}
 
 			return fields;
 		}
+
+		ParseResult ParseOps (HeaderFields_t&& fields, std::istream& istr)
+		{
+			ParseResult result { std::move (fields), {} };
+
+			boost::archive::text_iarchive iars (istr);
+			iars >> result.operations;
+			return result;
+		}
 	}
 
 	ParseResult Parse (const std::string& data)
@@ -70,11 +84,26 @@ namespace Laretz
 		std::istringstream istr (data);
 
 		auto fields = ParseHeaders (istr);
+		if (fields.count ("Content-Encoding"))
+			throw std::runtime_error ("compressed packet without a decompressor");
+
+		return ParseOps (std::move (fields), istr);
+	}
+
+	ParseResult Parse (const std::string& data, Inflater& inflater)
+	{
+		std::istringstream istr (data);
+
+		auto fields = ParseHeaders (istr);
+		const auto pos = fields.find ("Content-Encoding");
+		if (pos == fields.end ())
+			return ParseOps (std::move (fields), istr);
 
-		std::vector<Operation> ops;
-		boost::archive::text_iarchive iars (istr);
-		iars >> ops;
+		if (pos->second != "deflate")
+			throw std::runtime_error ("unsupported content encoding " + pos->second);
 
-		return { fields, ops };
+		const std::string compressed { std::istreambuf_iterator<char> (istr), std::istreambuf_iterator<char> () };
+		std::istringstream opsIstr (inflater (compressed));
+		return ParseOps (std::move (fields), opsIstr);
 	}
 }
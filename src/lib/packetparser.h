@@ -38,6 +38,7 @@ namespace Laretz
 	typedef std::map<std::string, std::string> HeaderFields_t;
 
 	class Operation;
+	class Inflater;
 
 	struct ParseResult
 	{
@@ -46,4 +47,5 @@ namespace Laretz
 	};
 
 	ParseResult Parse (const std::string&);
+	ParseResult Parse (const std::string&, Inflater&);
 }
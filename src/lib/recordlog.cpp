@@ -0,0 +1,216 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#include "recordlog.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <unistd.h>
+#include <boost/crc.hpp>
+
+namespace Laretz
+{
+	namespace
+	{
+		struct FileHeader
+		{
+			char m_magic [4];
+			uint32_t m_version;
+			uint64_t m_reserved;
+		};
+
+		struct RecordHeader
+		{
+			uint32_t m_length;
+			uint32_t m_checksum;
+		};
+
+		uint32_t Checksum (const char *data, size_t length)
+		{
+			boost::crc_32_type crc;
+			crc.process_bytes (data, length);
+			return crc.checksum ();
+		}
+
+		bool IsZero (const char *begin, const char *end)
+		{
+			return std::find_if (begin, end, [] (char c) { return c; }) == end;
+		}
+	}
+
+	RecordLog::RecordLog (const std::string& path, const std::string& magic, uint32_t version)
+	: m_magic (magic)
+	, m_version (version)
+	, m_file (new MappedFile (path, InitialSize))
+	, m_end (sizeof (FileHeader))
+	, m_recordsCount (0)
+	{
+		if (m_magic.size () != sizeof (FileHeader::m_magic))
+			throw std::logic_error ("record log magic should be four bytes long");
+
+		open ();
+	}
+
+	size_t RecordLog::append (const std::string& payload)
+	{
+		const auto offset = m_end;
+		const auto recordSize = sizeof (RecordHeader) + payload.size ();
+		reserve (recordSize);
+
+		const RecordHeader header { static_cast<uint32_t> (payload.size ()), Checksum (payload.data (), payload.size ()) };
+
+		const auto data = m_file->data () + offset;
+		std::memcpy (data + sizeof (RecordHeader), payload.data (), payload.size ());
+		std::memcpy (data, &header, sizeof (header));
+		m_file->sync (offset, recordSize);
+
+		m_end += recordSize;
+		++m_recordsCount;
+
+		return offset;
+	}
+
+	std::pair<const char*, size_t> RecordLog::read (size_t offset) const
+	{
+		if (offset < sizeof (FileHeader) || offset + sizeof (RecordHeader) > m_end)
+			throw std::out_of_range ("invalid record offset");
+
+		RecordHeader header;
+		std::memcpy (&header, m_file->data () + offset, sizeof (header));
+		return { m_file->data () + offset + sizeof (RecordHeader), header.m_length };
+	}
+
+	void RecordLog::forEach (const RecordHandler_t& handler) const
+	{
+		const auto data = m_file->data ();
+		const auto size = m_file->size ();
+
+		for (size_t pos = sizeof (FileHeader); pos + sizeof (RecordHeader) <= size; )
+		{
+			RecordHeader header;
+			std::memcpy (&header, data + pos, sizeof (header));
+
+			const auto payload = pos + sizeof (RecordHeader);
+			if (!header.m_length ||
+					header.m_length > size - payload ||
+					Checksum (data + payload, header.m_length) != header.m_checksum)
+				break;
+
+			handler (pos, data + payload, header.m_length);
+			pos = payload + header.m_length;
+		}
+	}
+
+	void RecordLog::clear ()
+	{
+		const auto usedSize = m_end;
+		std::memset (m_file->data () + sizeof (FileHeader), 0, usedSize - sizeof (FileHeader));
+		m_file->sync (0, usedSize);
+
+		m_end = sizeof (FileHeader);
+		m_recordsCount = 0;
+	}
+
+	void RecordLog::rewrite (const std::function<void (RecordLog&)>& fill)
+	{
+		const auto path = m_file->getPath ();
+		const auto tmpPath = path + ".rewrite";
+		::unlink (tmpPath.c_str ());
+		{
+			RecordLog log { tmpPath, m_magic, m_version };
+			fill (log);
+		}
+
+		m_file.reset ();
+		MappedFile::replace (tmpPath, path);
+		m_file.reset (new MappedFile (path, InitialSize));
+		open ();
+	}
+
+	size_t RecordLog::getRecordsCount () const
+	{
+		return m_recordsCount;
+	}
+
+	size_t RecordLog::getUsedSize () const
+	{
+		return m_end;
+	}
+
+	void RecordLog::open ()
+	{
+		m_end = sizeof (FileHeader);
+		m_recordsCount = 0;
+
+		const auto data = m_file->data ();
+		const auto size = m_file->size ();
+
+		FileHeader header;
+		std::memcpy (&header, data, sizeof (header));
+		if (std::memcmp (header.m_magic, m_magic.data (), m_magic.size ()))
+		{
+			if (!IsZero (data, data + size))
+				throw std::runtime_error ("unexpected file format: " + m_file->getPath ());
+
+			std::memcpy (header.m_magic, m_magic.data (), m_magic.size ());
+			header.m_version = m_version;
+			header.m_reserved = 0;
+			std::memcpy (data, &header, sizeof (header));
+			m_file->sync (0, sizeof (header));
+			return;
+		}
+
+		if (header.m_version != m_version)
+			throw std::runtime_error ("unsupported file version in " + m_file->getPath ());
+
+		forEach ([this] (size_t offset, const char*, size_t length)
+				{
+					m_end = offset + sizeof (RecordHeader) + length;
+					++m_recordsCount;
+				});
+
+		if (!IsZero (data + m_end, data + size))
+		{
+			std::memset (data + m_end, 0, size - m_end);
+			m_file->sync (m_end, size - m_end);
+		}
+	}
+
+	void RecordLog::reserve (size_t size)
+	{
+		if (m_end + size <= m_file->size ())
+			return;
+
+		auto newSize = m_file->size () * 2;
+		while (newSize < m_end + size)
+			newSize *= 2;
+		m_file->resize (newSize);
+	}
+}
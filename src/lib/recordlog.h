@@ -0,0 +1,73 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <functional>
+#include <boost/noncopyable.hpp>
+#include "mappedfile.h"
+
+namespace Laretz
+{
+	// Memory-mapped file of CRC-checked records. A record torn by a crash
+	// is detected on open and the log is cut right before it.
+	class RecordLog : boost::noncopyable
+	{
+		const std::string m_magic;
+		const uint32_t m_version;
+
+		std::unique_ptr<MappedFile> m_file;
+		size_t m_end;
+		size_t m_recordsCount;
+	public:
+		enum
+		{
+			InitialSize = 64 * 1024
+		};
+
+		typedef std::function<void (size_t offset, const char *data, size_t length)> RecordHandler_t;
+
+		RecordLog (const std::string& path, const std::string& magic, uint32_t version);
+
+		size_t append (const std::string& payload);
+		std::pair<const char*, size_t> read (size_t offset) const;
+		void forEach (const RecordHandler_t&) const;
+
+		void clear ();
+		void rewrite (const std::function<void (RecordLog&)>& fill);
+
+		size_t getRecordsCount () const;
+		size_t getUsedSize () const;
+	private:
+		void open ();
+		void reserve (size_t);
+	};
+}
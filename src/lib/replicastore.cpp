@@ -0,0 +1,367 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#include "replicastore.h"
+#include <sstream>
+#include <algorithm>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/vector.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/variant.hpp>
+#include "operation.h"
+#include "item.h"
+#include "packetparser.h"
+
+namespace Laretz
+{
+	namespace
+	{
+		enum RecordKind : char
+		{
+			Body = 'I',
+			Listed = 'L',
+			Deleted = 'D',
+			MaxSeq = 'S'
+		};
+
+		const size_t MinCompactRecords = 1024;
+
+		std::string Serialize (RecordKind kind, const Item& item)
+		{
+			std::ostringstream ostr;
+			ostr.put (kind);
+			boost::archive::binary_oarchive oar (ostr, boost::archive::no_header);
+			oar << item;
+			return ostr.str ();
+		}
+
+		Item Deserialize (const char *data, size_t length)
+		{
+			std::istringstream istr (std::string (data + 1, length - 1));
+			boost::archive::binary_iarchive iar (istr, boost::archive::no_header);
+
+			Item item;
+			iar >> item;
+			return item;
+		}
+	}
+
+	ReplicaStore::ReplicaStore (const std::string& path)
+	: m_log (path, "LRZR", 1)
+	, m_maxSeq (0)
+	, m_pendingSeq (0)
+	{
+		m_log.forEach ([this] (size_t offset, const char *data, size_t length)
+				{ load (data [0], offset, Deserialize (data, length)); });
+	}
+
+	void ReplicaStore::apply (const Operation& op)
+	{
+		switch (op.getType ())
+		{
+		case OpType::Append:
+		case OpType::Fetch:
+			for (const auto& item : op.getItems ())
+				store (item);
+			break;
+		case OpType::Modify:
+			for (const auto& item : op.getItems ())
+			{
+				const auto pos = m_entries.find (item.getId ());
+				if (pos == m_entries.end () || !pos->second.m_offset)
+				{
+					markListed (item.getId (), item.getSeq ());
+					continue;
+				}
+
+				auto merged = readItem (pos->second.m_offset);
+				merged += item;
+				store (merged);
+			}
+			break;
+		case OpType::List:
+		case OpType::Refetch:
+			for (const auto& item : op.getItems ())
+				markListed (item.getId (), item.getSeq ());
+			break;
+		case OpType::Delete:
+			for (const auto& item : op.getItems ())
+				remove (item.getId (), item.getSeq ());
+			break;
+		case OpType::FetchBlob:
+		case OpType::Digest:
+			break;
+		case OpType::UploadBlob:
+			for (const auto& item : op.getItems ())
+				if (item.find ("uploadFinal"))
+					markListed (item.getId (), item.getSeq ());
+			break;
+		case OpType::Subscribe:
+			for (const auto& item : op.getItems ())
+			{
+				const auto field = item.find ("op");
+				const auto type = field ? boost::get<int64_t> (field) : nullptr;
+				if (!type)
+					continue;
+
+				if (*type == static_cast<int64_t> (OpType::Delete))
+					remove (item.getId (), item.getSeq ());
+				else
+					markListed (item.getId (), item.getSeq ());
+			}
+			break;
+		}
+
+		maybeCompact ();
+	}
+
+	void ReplicaStore::apply (const std::vector<Operation>& ops)
+	{
+		for (const auto& op : ops)
+			apply (op);
+	}
+
+	void ReplicaStore::apply (const ParseResult& result)
+	{
+		apply (result.operations);
+
+		const auto statusPos = result.fields.find ("Status");
+		if (statusPos != result.fields.end () && statusPos->second == "Error")
+		{
+			m_pendingSeq = 0;
+			return;
+		}
+
+		bool isList = false;
+		for (const auto& op : result.operations)
+		{
+			switch (op.getType ())
+			{
+			case OpType::List:
+				isList = true;
+				// Fall through.
+			case OpType::Delete:
+			case OpType::Fetch:
+				for (const auto& item : op.getItems ())
+					m_pendingSeq = std::max (m_pendingSeq, item.getSeq ());
+				break;
+			default:
+				break;
+			}
+		}
+
+		if (!isList || result.fields.count ("Cursor"))
+			return;
+
+		if (m_pendingSeq > m_maxSeq)
+		{
+			const Item item { std::string (), m_pendingSeq };
+			load (MaxSeq, m_log.append (Serialize (MaxSeq, item)), item);
+		}
+		m_pendingSeq = 0;
+	}
+
+	boost::optional<Item> ReplicaStore::getItem (const std::string& id) const
+	{
+		const auto pos = m_entries.find (id);
+		if (pos == m_entries.end () || !pos->second.m_offset)
+			return {};
+
+		return readItem (pos->second.m_offset);
+	}
+
+	std::vector<Item> ReplicaStore::getChildren (const std::string& parentId) const
+	{
+		std::vector<Item> result;
+
+		const auto pos = m_children.find (parentId);
+		if (pos == m_children.end ())
+			return result;
+
+		result.reserve (pos->second.size ());
+		for (const auto& id : pos->second)
+			result.push_back (readItem (m_entries.at (id).m_offset));
+		return result;
+	}
+
+	SubtreeDigest ReplicaStore::getDigest (const std::string& parentId) const
+	{
+		SubtreeDigest result;
+
+		const auto pos = m_children.find (parentId);
+		if (pos == m_children.end ())
+			return result;
+
+		for (const auto& id : pos->second)
+		{
+			const auto& entry = m_entries.at (id);
+			result.add (id, std::max (entry.m_seq, entry.m_listedSeq));
+			result += getDigest (id);
+		}
+		return result;
+	}
+
+	std::vector<std::string> ReplicaStore::getStaleIds () const
+	{
+		std::vector<std::string> result;
+		for (const auto& pair : m_entries)
+			if (pair.second.m_listedSeq > pair.second.m_seq)
+				result.push_back (pair.first);
+		std::sort (result.begin (), result.end ());
+		return result;
+	}
+
+	bool ReplicaStore::contains (const std::string& id) const
+	{
+		const auto pos = m_entries.find (id);
+		return pos != m_entries.end () && pos->second.m_offset;
+	}
+
+	size_t ReplicaStore::size () const
+	{
+		return m_entries.size ();
+	}
+
+	uint64_t ReplicaStore::getMaxSeq () const
+	{
+		return m_maxSeq;
+	}
+
+	void ReplicaStore::compact ()
+	{
+		m_log.rewrite ([this] (RecordLog& log)
+				{
+					log.append (Serialize (MaxSeq, Item (std::string (), m_maxSeq)));
+					for (const auto& pair : m_entries)
+					{
+						const auto& entry = pair.second;
+						if (entry.m_offset)
+						{
+							const auto& record = m_log.read (entry.m_offset);
+							log.append ({ record.first, record.second });
+						}
+						if (entry.m_listedSeq > entry.m_seq)
+							log.append (Serialize (Listed, Item (pair.first, entry.m_listedSeq)));
+					}
+				});
+
+		m_entries.clear ();
+		m_children.clear ();
+		m_log.forEach ([this] (size_t offset, const char *data, size_t length)
+				{ load (data [0], offset, Deserialize (data, length)); });
+	}
+
+	void ReplicaStore::store (const Item& item)
+	{
+		load (Body, m_log.append (Serialize (Body, item)), item);
+	}
+
+	void ReplicaStore::markListed (const std::string& id, uint64_t seq)
+	{
+		const auto pos = m_entries.find (id);
+		if (pos != m_entries.end () &&
+				(pos->second.m_seq >= seq || pos->second.m_listedSeq >= seq))
+			return;
+
+		const Item item { id, seq };
+		load (Listed, m_log.append (Serialize (Listed, item)), item);
+	}
+
+	void ReplicaStore::remove (const std::string& id, uint64_t seq)
+	{
+		const Item item { id, seq };
+		load (Deleted, m_log.append (Serialize (Deleted, item)), item);
+	}
+
+	void ReplicaStore::load (char kind, size_t offset, const Item& item)
+	{
+		switch (kind)
+		{
+		case Body:
+		{
+			auto& entry = m_entries [item.getId ()];
+			if (entry.m_offset && entry.m_parentId != item.getParentId ())
+				unlinkChild (item.getId (), entry.m_parentId);
+
+			entry.m_offset = offset;
+			entry.m_seq = item.getSeq ();
+			entry.m_parentId = item.getParentId ();
+			m_children [entry.m_parentId].insert (item.getId ());
+			break;
+		}
+		case Listed:
+		{
+			auto& entry = m_entries [item.getId ()];
+			entry.m_listedSeq = std::max (entry.m_listedSeq, item.getSeq ());
+			break;
+		}
+		case Deleted:
+		{
+			const auto pos = m_entries.find (item.getId ());
+			if (pos == m_entries.end ())
+				break;
+
+			if (pos->second.m_offset)
+				unlinkChild (item.getId (), pos->second.m_parentId);
+			m_entries.erase (pos);
+			break;
+		}
+		case MaxSeq:
+			m_maxSeq = std::max (m_maxSeq, item.getSeq ());
+			break;
+		default:
+			break;
+		}
+	}
+
+	void ReplicaStore::unlinkChild (const std::string& id, const std::string& parentId)
+	{
+		const auto pos = m_children.find (parentId);
+		if (pos == m_children.end ())
+			return;
+
+		pos->second.erase (id);
+		if (pos->second.empty ())
+			m_children.erase (pos);
+	}
+
+	Item ReplicaStore::readItem (size_t offset) const
+	{
+		const auto& record = m_log.read (offset);
+		return Deserialize (record.first, record.second);
+	}
+
+	void ReplicaStore::maybeCompact ()
+	{
+		const auto records = m_log.getRecordsCount ();
+		if (records > MinCompactRecords && records > 4 * (m_entries.size () + 1))
+			compact ();
+	}
+}
@@ -0,0 +1,102 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <boost/optional.hpp>
+#include <boost/noncopyable.hpp>
+#include "recordlog.h"
+#include "digest.h"
+
+namespace Laretz
+{
+	class Item;
+	class Operation;
+	struct ParseResult;
+
+	// Local copy of the items last synced with the server. Replies are
+	// applied incrementally, and everything is kept in an append-only
+	// memory-mapped file that's compacted once it's mostly garbage.
+	class ReplicaStore : boost::noncopyable
+	{
+		struct Entry
+		{
+			size_t m_offset;
+			uint64_t m_seq;
+			uint64_t m_listedSeq;
+			std::string m_parentId;
+		};
+
+		RecordLog m_log;
+
+		std::unordered_map<std::string, Entry> m_entries;
+		std::unordered_map<std::string, std::set<std::string>> m_children;
+
+		uint64_t m_maxSeq;
+		uint64_t m_pendingSeq;
+		size_t m_deadRecords;
+	public:
+		ReplicaStore (const std::string& path);
+
+		void apply (const Operation&);
+		void apply (const std::vector<Operation>&);
+		// Also moves the max seq forward once a List range is over, that
+		// is, on a List reply without a cursor to continue from.
+		void apply (const ParseResult&);
+
+		boost::optional<Item> getItem (const std::string& id) const;
+		std::vector<Item> getChildren (const std::string& parentId) const;
+		// Computed the same way as the server's Digest replies, using the
+		// newest seq known for every item.
+		SubtreeDigest getDigest (const std::string& parentId) const;
+		std::vector<std::string> getStaleIds () const;
+
+		bool contains (const std::string& id) const;
+		size_t size () const;
+
+		// The seq everything is known to be listed up to, for the next List.
+		uint64_t getMaxSeq () const;
+
+		void compact ();
+	private:
+		void store (const Item&);
+		void markListed (const std::string& id, uint64_t seq);
+		void remove (const std::string& id, uint64_t seq);
+
+		void load (char kind, size_t offset, const Item&);
+		void unlinkChild (const std::string& id, const std::string& parentId);
+
+		Item readItem (size_t offset) const;
+		void maybeCompact ();
+	};
+}
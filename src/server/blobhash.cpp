@@ -0,0 +1,80 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#include "blobhash.h"
+#include <iterator>
+#include <stdexcept>
+#include <openssl/evp.h>
+#include <boost/algorithm/hex.hpp>
+#include "item.h"
+
+namespace Laretz
+{
+	ContentHasher::ContentHasher ()
+	: m_ctx (EVP_MD_CTX_new (), &EVP_MD_CTX_free)
+	{
+		if (!m_ctx || !EVP_DigestInit_ex (m_ctx.get (), EVP_sha256 (), nullptr))
+			throw std::runtime_error ("unable to initialize blob hashing");
+	}
+
+	void ContentHasher::update (const char *data, size_t size)
+	{
+		if (!EVP_DigestUpdate (m_ctx.get (), data, size))
+			throw std::runtime_error ("unable to hash blob contents");
+	}
+
+	std::string ContentHasher::finish ()
+	{
+		unsigned char digest [EVP_MAX_MD_SIZE];
+		unsigned int digestSize = 0;
+		if (!EVP_DigestFinal_ex (m_ctx.get (), digest, &digestSize))
+			throw std::runtime_error ("unable to hash blob contents");
+
+		std::string result;
+		result.reserve (digestSize * 2);
+		boost::algorithm::hex_lower (digest, digest + digestSize, std::back_inserter (result));
+		return result;
+	}
+
+	std::string ContentHash (const Blob& blob)
+	{
+		ContentHasher hasher;
+		hasher.update (blob.data (), blob.size ());
+		return hasher.finish ();
+	}
+
+	void ReplaceBlobsWithRefs (Item& item)
+	{
+		for (auto& field : item)
+			if (const auto blob = boost::get<Blob> (&field.second))
+			{
+				BlobRef ref { blob->size (), ContentHash (*blob) };
+				field.second = std::move (ref);
+			}
+	}
+}
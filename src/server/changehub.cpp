@@ -0,0 +1,104 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#include "changehub.h"
+#include <algorithm>
+
+namespace Laretz
+{
+	ChangeHub::Subscription::Subscription (const Entry_ptr& entry)
+	: m_entry (entry)
+	{
+	}
+
+	auto ChangeHub::subscribe (const std::string& user, const std::string& parentId,
+			bool subtree, const Handler_t& handler) -> Subscription_ptr
+	{
+		const auto entry = std::make_shared<Entry> (Entry { parentId, subtree, handler });
+
+		std::lock_guard<std::mutex> lock (m_mutex);
+		auto& entries = m_user2entries [user];
+		entries.erase (std::remove_if (entries.begin (), entries.end (),
+					[] (const std::weak_ptr<Entry>& entry) { return entry.expired (); }),
+				entries.end ());
+		entries.push_back (entry);
+
+		return std::make_shared<Subscription> (entry);
+	}
+
+	bool ChangeHub::hasSubscribers (const std::string& user) const
+	{
+		std::lock_guard<std::mutex> lock (m_mutex);
+		return m_user2entries.find (user) != m_user2entries.end ();
+	}
+
+	void ChangeHub::publish (const std::string& user, const ChangeNotice& notice,
+			const std::function<std::vector<std::string> ()>& ancestors)
+	{
+		std::vector<Entry_ptr> direct;
+		std::vector<Entry_ptr> subtrees;
+		{
+			std::lock_guard<std::mutex> lock (m_mutex);
+			const auto pos = m_user2entries.find (user);
+			if (pos == m_user2entries.end ())
+				return;
+
+			auto& entries = pos->second;
+			for (auto i = entries.begin (); i != entries.end (); )
+			{
+				const auto entry = i->lock ();
+				if (!entry)
+				{
+					i = entries.erase (i);
+					continue;
+				}
+				++i;
+
+				if (entry->m_parentId == notice.m_parentId ||
+						(entry->m_subtree && entry->m_parentId.empty ()))
+					direct.push_back (entry);
+				else if (entry->m_subtree)
+					subtrees.push_back (entry);
+			}
+
+			if (entries.empty ())
+				m_user2entries.erase (pos);
+		}
+
+		if (!subtrees.empty ())
+		{
+			const auto& chain = ancestors ();
+			for (const auto& entry : subtrees)
+				if (std::find (chain.begin (), chain.end (), entry->m_parentId) != chain.end ())
+					direct.push_back (entry);
+		}
+
+		for (const auto& entry : direct)
+			entry->m_handler (notice);
+	}
+}
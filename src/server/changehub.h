@@ -0,0 +1,88 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <boost/noncopyable.hpp>
+#include "operation.h"
+
+namespace Laretz
+{
+	struct ChangeNotice
+	{
+		std::string m_id;
+		std::string m_parentId;
+		uint64_t m_seq;
+		OpType m_type;
+	};
+
+	// Dispatches committed changes of every user to the connections that
+	// have subscribed to the changed item's parent or one of its ancestors.
+	class ChangeHub : boost::noncopyable
+	{
+	public:
+		typedef std::function<void (const ChangeNotice&)> Handler_t;
+
+		class Subscription;
+		typedef std::shared_ptr<Subscription> Subscription_ptr;
+	private:
+		struct Entry
+		{
+			std::string m_parentId;
+			bool m_subtree;
+			Handler_t m_handler;
+		};
+		typedef std::shared_ptr<Entry> Entry_ptr;
+
+		mutable std::mutex m_mutex;
+		std::unordered_map<std::string, std::vector<std::weak_ptr<Entry>>> m_user2entries;
+	public:
+		Subscription_ptr subscribe (const std::string& user, const std::string& parentId,
+				bool subtree, const Handler_t&);
+
+		bool hasSubscribers (const std::string& user) const;
+		void publish (const std::string& user, const ChangeNotice&,
+				const std::function<std::vector<std::string> ()>& ancestors);
+	};
+
+	// Keeps the subscription registered for as long as it lives.
+	class ChangeHub::Subscription : boost::noncopyable
+	{
+		const Entry_ptr m_entry;
+	public:
+		Subscription (const Entry_ptr&);
+	};
+
+	typedef std::shared_ptr<ChangeHub> ChangeHub_ptr;
+}
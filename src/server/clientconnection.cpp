@@ -28,25 +28,51 @@
 
 #include "clientconnection.h"
 #include <string>
+#include <algorithm>
 #include <iostream>
+#include <functional>
 #include <boost/asio/read_until.hpp>
 #include <boost/asio/write.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread/locks.hpp>
 #include "packetparser.h"
 #include "packetgenerator.h"
 #include "operation.h"
 #include "dbmanager.h"
 #include "dboperator.h"
+#include "liststream.h"
 #include "db.h"
 
 namespace
 {
+	const size_t MaxHeaderSize = 64 * 1024;
+	const long RetryInterval = 50;
+	const long NoticeCoalesceInterval = 50;
+	const int64_t MaxListWait = 5 * 60 * 1000;
+
+	Laretz::PacketGenerator MakeErrorPacket (const std::string& reason, int code)
+	{
+		return
+		{
+			{
+				{ "Status", "Error" },
+				{ "Reason", reason },
+				{ "ErrorCode", boost::lexical_cast<std::string> (code) }
+			}
+		};
+	}
+
 	class MatchPacketEnd
 	{
+		std::function<bool (const std::string&)> m_admit;
+
+		bool m_hasHeader;
 		size_t m_expectedLength;
 	public:
-		MatchPacketEnd ()
-		: m_expectedLength (0)
+		MatchPacketEnd (const std::function<bool (const std::string&)>& admit)
+		: m_admit (admit)
+		, m_hasHeader (false)
+		, m_expectedLength (0)
 		{
 		}
 
@@ -54,7 +80,7 @@ namespace
 		std::pair<Iterator, bool> operator() (Iterator begin, Iterator end)
 		{
 			std::string input (begin, end);
-			if (!m_expectedLength)
+			if (!m_hasHeader)
 			{
 				const std::string lengthMarker ("Length: ");
 				const auto pos = input.find (lengthMarker);
@@ -65,11 +91,15 @@ namespace
 						headerEnd == std::string::npos)
 					return { begin, false };
 
+				begin += headerEnd + 2;
+
 				const auto numStart = pos + lengthMarker.size ();
-				const auto num = boost::lexical_cast<size_t> (input.substr (numStart, nextLine - numStart));
-				m_expectedLength = num;
+				const auto& numStr = input.substr (numStart, nextLine - numStart);
+				if (!m_admit (numStr))
+					return { begin, true };
 
-				begin += headerEnd + 2;
+				m_hasHeader = true;
+				m_expectedLength = boost::lexical_cast<size_t> (numStr);
 			}
 
 			const auto hasFullPacket = std::distance (begin, end) >= static_cast<ptrdiff_t> (m_expectedLength);
@@ -78,6 +108,33 @@ namespace
 	};
 }
 
+namespace Laretz
+{
+	namespace
+	{
+		int64_t GetListWait (const std::vector<Operation>& ops)
+		{
+			for (const auto& op : ops)
+			{
+				if (op.getType () != OpType::List || op.getItems ().empty ())
+					continue;
+
+				const auto field = op.getItems ().front ().find ("wait");
+				const auto wait = field ? boost::get<int64_t> (field) : nullptr;
+				if (wait && *wait > 0)
+					return std::min (*wait, MaxListWait);
+			}
+			return 0;
+		}
+
+		bool IsEmptyReply (const std::vector<Operation>& ops)
+		{
+			return std::all_of (ops.begin (), ops.end (),
+					[] (const Operation& op) { return op.empty (); });
+		}
+	}
+}
+
 namespace boost
 {
 namespace asio
@@ -91,12 +148,32 @@ namespace Laretz
 {
 	namespace asio = boost::asio;
 
-	ClientConnection::ClientConnection (boost::asio::io_service& io, std::shared_ptr<DBManager> dbMgr)
+	ClientConnection::ClientConnection (boost::asio::io_service& io, std::shared_ptr<DBManager> dbMgr,
+			const ServerLimits& limits, MemoryBudget_ptr budget)
 	: m_dbMgr (dbMgr)
+	, m_limits (limits)
+	, m_budget (budget)
 	, m_io (io)
 	, m_socket (io)
 	, m_strand (io)
+	, m_buf (limits.m_maxPacketSize + MaxHeaderSize)
+	, m_retryTimer (io)
+	, m_reading (false)
+	, m_closing (false)
+	, m_rxReserved (0)
+	, m_inflater (limits.m_maxPacketSize)
+	, m_compressReplies (false)
+	, m_outBytes (0)
+	, m_noticeTimer (io)
+	, m_noticeTimerArmed (false)
+	, m_parkTimer (io)
+	{
+	}
+
+	ClientConnection::~ClientConnection ()
 	{
+		releaseReserved ();
+		m_budget->release (m_outBytes);
 	}
 
 	asio::ip::tcp::socket& ClientConnection::getSocket ()
@@ -106,30 +183,120 @@ namespace Laretz
 
 	void ClientConnection::start ()
 	{
+		m_reading = true;
+
 		auto shared = shared_from_this ();
 		boost::asio::async_read_until (m_socket,
-				m_buf, MatchPacketEnd (),
+				m_buf, MatchPacketEnd ([this] (const std::string& length) { return admitPacket (length); }),
 				m_strand.wrap ([shared] (const boost::system::error_code& ec, std::size_t bytes)
 						{ shared->handleRead (ec, bytes); }));
 	}
 
+	void ClientConnection::resumeRead ()
+	{
+		if (m_reading || m_closing || m_pendingList || m_parkedRequest ||
+				m_outBytes > m_limits.m_maxConnectionBuffer)
+			return;
+
+		if (m_budget->isExhausted ())
+		{
+			auto shared = shared_from_this ();
+			m_retryTimer.expires_from_now (boost::posix_time::milliseconds (RetryInterval));
+			m_retryTimer.async_wait (m_strand.wrap ([shared] (const boost::system::error_code& ec)
+						{
+							if (!ec)
+								shared->resumeRead ();
+						}));
+			return;
+		}
+
+		start ();
+	}
+
+	bool ClientConnection::admitPacket (const std::string& lengthStr)
+	{
+		size_t length = 0;
+		try
+		{
+			length = boost::lexical_cast<size_t> (lengthStr);
+		}
+		catch (const boost::bad_lexical_cast&)
+		{
+			m_rejection = "invalid packet length";
+			return false;
+		}
+
+		if (length > m_limits.m_maxPacketSize)
+		{
+			m_rejection = "packet too large";
+			return false;
+		}
+
+		if (!m_budget->tryAcquire (length))
+		{
+			m_rejection = "server is out of memory, try again later";
+			return false;
+		}
+
+		m_rxReserved = length;
+		return true;
+	}
+
+	void ClientConnection::releaseReserved ()
+	{
+		m_budget->release (m_rxReserved);
+		m_rxReserved = 0;
+	}
+
 	void ClientConnection::handleRead (const boost::system::error_code& ec, size_t bytesRead)
 	{
+		m_reading = false;
+
 		if (ec)
+			releaseReserved ();
+
+		if (ec == asio::error::not_found)
+		{
+			m_closing = true;
+			writeErrorResponse ("packet too large");
+			return;
+		}
+		else if (ec)
 		{
 			if (ec.value () != boost::system::errc::no_such_file_or_directory)
 				std::cerr << "error reading " << ec.value () << "; " << ec.message () << std::endl;
+			m_closing = true;
+			m_subscriptions.clear ();
+			m_noticeTimer.cancel ();
+			m_parkedRequest.reset ();
+			m_parkWatch.reset ();
+			m_parkTimer.cancel ();
 			return;
 		}
 
 		const std::string data (asio::buffer_cast<const char*> (m_buf.data ()), bytesRead);
 		m_buf.consume (bytesRead);
-		start ();
 
+		if (!m_rejection.empty ())
+		{
+			releaseReserved ();
+			m_closing = true;
+			writeErrorResponse (m_rejection);
+			return;
+		}
+
+		handlePacket (data);
+		releaseReserved ();
+
+		resumeRead ();
+	}
+
+	void ClientConnection::handlePacket (const std::string& data)
+	{
 		ParseResult result;
 		try
 		{
-			result = Parse (data);
+			result = Parse (data, m_inflater);
 		}
 		catch (const std::exception& e)
 		{
@@ -137,11 +304,19 @@ namespace Laretz
 			return;
 		}
 
+		handleRequest (std::move (result));
+	}
+
+	void ClientConnection::handleRequest (ParseResult&& result)
+	{
 		auto getSafe = [&result] (const std::string& name) -> std::string
 		{
 			const auto pos = result.fields.find (name);
 			return pos == result.fields.end () ? std::string () : pos->second;
 		};
+		if (getSafe ("Accept-Encoding").find ("deflate") != std::string::npos)
+			m_compressReplies = true;
+
 		const auto& login = getSafe ("Login");
 		const auto& pass = getSafe ("Password");
 
@@ -158,39 +333,316 @@ namespace Laretz
 
 		try
 		{
-			PacketGenerator pg { { { "Status", "Success" } } };
-			pg [DBOperator { db } (result.operations)];
+			DBOperator dbOp { db };
 
-			auto shared = shared_from_this ();
-			boost::asio::async_write (m_socket,
-					boost::asio::buffer (pg ()),
-					[shared] (const boost::system::error_code&, std::size_t) {});
+			const bool atomic = getSafe ("Batch") == "atomic";
+			dbOp.setAtomic (atomic);
+
+			// The watch is set up before the query, so a commit landing in
+			// between still wakes up the parked request.
+			const auto wait = GetListWait (result.operations);
+			if (wait)
+				watchParked (db);
+
+			std::vector<Operation> ops;
+			{
+				// Atomic batches exclude any other requests of the same user,
+				// so those see either all of a batch or nothing of it.
+				boost::shared_lock<boost::shared_mutex> sharedLock { db->getMutex (), boost::defer_lock };
+				boost::unique_lock<boost::shared_mutex> uniqueLock { db->getMutex (), boost::defer_lock };
+				if (atomic)
+					uniqueLock.lock ();
+				else
+					sharedLock.lock ();
+
+				ops = wait ?
+						dbOp (result.operations) :
+						dbOp (std::move (result.operations));
+			}
+			if (wait && IsEmptyReply (ops) && park (std::move (result), wait))
+				return;
+			m_parkWatch.reset ();
+
+			const auto& list = dbOp.getListStream ();
+			if (list && !list->atEnd ())
+			{
+				m_pendingList = list;
+				m_pendingListDB = db;
+			}
+
+			for (const auto& req : dbOp.getSubscriptionRequests ())
+				if (req.m_cancel)
+					m_subscriptions.erase (req.m_parentId);
+				else
+					m_subscriptions [req.m_parentId] = db->subscribe (req.m_parentId, req.m_subtree, makeNoticeHandler ());
+
+			PacketGenerator pg { { { "Status", m_pendingList ? "Partial" : "Success" } } };
+			if (list && !list->isComplete ())
+				pg ({ "Cursor", list->getCursor () });
+			if (list && list->hasIndexedRoots ())
+				pg ({ "Roots", list->getChunkRoots () });
+			pg [std::move (ops)];
+
+			writePacket (pg);
 		}
 		catch (const DBOpError& e)
 		{
+			m_parkWatch.reset ();
 			writeErrorResponse (e.what (), e.getEC ());
 		}
 		catch (const std::exception& e)
 		{
+			m_parkWatch.reset ();
 			writeErrorResponse (e.what ());
 		}
 	}
 
+	void ClientConnection::watchParked (DB_ptr db)
+	{
+		std::weak_ptr<ClientConnection> weak = shared_from_this ();
+		m_parkWatch = db->subscribe ({}, true,
+				[weak] (const ChangeNotice&)
+				{
+					if (const auto shared = weak.lock ())
+						shared->m_strand.post ([shared] { shared->wakeParked (); });
+				});
+	}
+
+	bool ClientConnection::park (ParseResult&& request, int64_t waitMs)
+	{
+		const auto now = boost::posix_time::microsec_clock::universal_time ();
+		if (m_parkDeadline.is_not_a_date_time ())
+			m_parkDeadline = now + boost::posix_time::milliseconds (waitMs);
+
+		if (now >= m_parkDeadline)
+		{
+			m_parkDeadline = boost::posix_time::ptime ();
+			return false;
+		}
+
+		m_parkedRequest = std::make_shared<ParseResult> (std::move (request));
+
+		auto shared = shared_from_this ();
+		m_parkTimer.expires_at (m_parkDeadline);
+		m_parkTimer.async_wait (m_strand.wrap ([shared] (const boost::system::error_code& ec)
+					{
+						if (!ec)
+							shared->wakeParked ();
+					}));
+		return true;
+	}
+
+	void ClientConnection::wakeParked ()
+	{
+		if (!m_parkedRequest)
+			return;
+
+		const auto request = m_parkedRequest;
+		m_parkedRequest.reset ();
+		m_parkWatch.reset ();
+		m_parkTimer.cancel ();
+
+		handleRequest (std::move (*request));
+		if (!m_parkedRequest)
+			m_parkDeadline = boost::posix_time::ptime ();
+
+		resumeRead ();
+	}
+
 	void ClientConnection::writeErrorResponse (const std::string& reason, int code)
 	{
 		std::cerr << "writing invalid " << code << " -> " << reason << std::endl;
-		PacketGenerator pg
+		writePacket (MakeErrorPacket (reason, code));
+	}
+
+	void ClientConnection::writePacket (const PacketGenerator& pg)
+	{
+		const auto& serialized = pg.serialize ();
+
+		// The budget is taken before compressing: the deflate stream is
+		// shared by all the replies, so whatever goes through it must be
+		// sent. Neither can a reply be swapped for a retryable error, as
+		// the request may have been committed already, or the reply may be
+		// a notice, so the connection is dropped instead.
+		const auto bound = pg.getSizeBound (serialized, m_deflater);
+		if (!m_budget->tryAcquire (bound))
+		{
+			std::cerr << "out of memory for a reply, dropping the connection" << std::endl;
+			dropConnection ();
+			return;
+		}
+
+		auto packet = m_compressReplies ? pg (serialized, m_deflater) : pg (serialized);
+		const auto size = packet.size ();
+		m_budget->release (bound - size);
+
+		m_outQueue.push_back (std::move (packet));
+		m_outBytes += size;
+
+		if (m_outQueue.size () == 1)
+			writeFront ();
+	}
+
+	void ClientConnection::dropConnection ()
+	{
+		m_closing = true;
+		m_pendingList.reset ();
+		m_pendingListDB.reset ();
+		m_subscriptions.clear ();
+		m_noticeTimer.cancel ();
+		m_parkedRequest.reset ();
+		m_parkWatch.reset ();
+		m_parkTimer.cancel ();
+
+		// Pending reads and writes complete with an error and release
+		// what they hold.
+		boost::system::error_code ec;
+		m_socket.shutdown (asio::ip::tcp::socket::shutdown_both, ec);
+		m_socket.close (ec);
+	}
+
+	void ClientConnection::writeFront ()
+	{
+		auto shared = shared_from_this ();
+		boost::asio::async_write (m_socket,
+				boost::asio::buffer (m_outQueue.front ()),
+				m_strand.wrap ([shared] (const boost::system::error_code& ec, std::size_t)
+						{ shared->handleWrite (ec); }));
+	}
+
+	void ClientConnection::handleWrite (const boost::system::error_code& ec)
+	{
+		if (ec)
+		{
+			std::cerr << "error writing " << ec.value () << "; " << ec.message () << std::endl;
+			m_budget->release (m_outBytes);
+			m_outBytes = 0;
+			m_outQueue.clear ();
+			m_pendingList.reset ();
+			m_pendingListDB.reset ();
+			m_subscriptions.clear ();
+			m_noticeTimer.cancel ();
+			m_closing = true;
+			return;
+		}
+
+		const auto size = m_outQueue.front ().size ();
+		m_outBytes -= size;
+		m_budget->release (size);
+		m_outQueue.pop_front ();
+
+		if (!m_outQueue.empty ())
+			writeFront ();
+		else if (m_pendingList)
+			writeListChunk ();
+
+		resumeRead ();
+	}
+
+	void ClientConnection::writeListChunk ()
+	{
+		try
 		{
+			// Later chunks are read in between other requests, so they need
+			// the same protection from atomic batches as the first one.
+			boost::shared_lock<boost::shared_mutex> lock { m_pendingListDB->getMutex () };
+
+			auto ops = m_pendingList->nextOps ();
+			const bool hasMore = !m_pendingList->atEnd ();
+
+			PacketGenerator pg { { { "Status", hasMore ? "Partial" : "Success" } } };
+			if (!m_pendingList->isComplete ())
+				pg ({ "Cursor", m_pendingList->getCursor () });
+			if (m_pendingList->hasIndexedRoots ())
+				pg ({ "Roots", m_pendingList->getChunkRoots () });
+			pg [std::move (ops)];
+			lock.unlock ();
+
+			if (!hasMore)
 			{
-				{ "Status", "Error" },
-				{ "Reason", reason },
-				{ "ErrorCode", boost::lexical_cast<std::string> (code) }
+				m_pendingList.reset ();
+				m_pendingListDB.reset ();
 			}
-		};
-		const auto& data = pg ();
+
+			writePacket (pg);
+		}
+		catch (const std::exception& e)
+		{
+			m_pendingList.reset ();
+			m_pendingListDB.reset ();
+			writeErrorResponse (e.what ());
+		}
+	}
+
+	ChangeHub::Handler_t ClientConnection::makeNoticeHandler ()
+	{
+		std::weak_ptr<ClientConnection> weak = shared_from_this ();
+		return [weak] (const ChangeNotice& notice)
+			{
+				if (const auto shared = weak.lock ())
+					shared->m_strand.post ([shared, notice] { shared->queueNotice (notice); });
+			};
+	}
+
+	void ClientConnection::queueNotice (const ChangeNotice& notice)
+	{
+		if (m_closing)
+			return;
+
+		const auto pos = m_pendingNotices.find (notice.m_id);
+		if (pos == m_pendingNotices.end ())
+			m_pendingNotices.insert ({ notice.m_id, notice });
+		else
+		{
+			const bool wasAppended = pos->second.m_type == OpType::Append;
+			pos->second = notice;
+			if (wasAppended && notice.m_type == OpType::Modify)
+				pos->second.m_type = OpType::Append;
+		}
+
+		scheduleNotices ();
+	}
+
+	void ClientConnection::scheduleNotices ()
+	{
+		if (m_noticeTimerArmed)
+			return;
+
+		m_noticeTimerArmed = true;
+
 		auto shared = shared_from_this ();
-		boost::asio::async_write (m_socket,
-				boost::asio::buffer (data),
-				[shared] (const boost::system::error_code&, std::size_t) {});
+		m_noticeTimer.expires_from_now (boost::posix_time::milliseconds (NoticeCoalesceInterval));
+		m_noticeTimer.async_wait (m_strand.wrap ([shared] (const boost::system::error_code& ec)
+					{
+						shared->m_noticeTimerArmed = false;
+						if (!ec)
+							shared->writeNotices ();
+					}));
+	}
+
+	void ClientConnection::writeNotices ()
+	{
+		if (m_closing || m_pendingNotices.empty ())
+			return;
+
+		if (m_outBytes > m_limits.m_maxConnectionBuffer)
+		{
+			scheduleNotices ();
+			return;
+		}
+
+		std::vector<Item> items;
+		items.reserve (m_pendingNotices.size ());
+		for (const auto& pair : m_pendingNotices)
+		{
+			const auto& notice = pair.second;
+			items.push_back ({ notice.m_id, notice.m_parentId, notice.m_seq });
+			items.back () ["op"] = static_cast<int64_t> (notice.m_type);
+		}
+		m_pendingNotices.clear ();
+
+		PacketGenerator pg { { { "Status", "Notify" } } };
+		pg (Operation { OpType::Subscribe, std::move (items) });
+		writePacket (pg);
 	}
 }
@@ -29,33 +29,101 @@
 #pragma once
 
 #include <memory>
+#include <deque>
+#include <map>
+#include <string>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/asio/streambuf.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include "compression.h"
+#include "serverlimits.h"
+#include "memorybudget.h"
+#include "changehub.h"
 
 namespace Laretz
 {
 	class DBManager;
+	class PacketGenerator;
+	struct ParseResult;
+
+	class DB;
+	typedef std::shared_ptr<DB> DB_ptr;
+
+	class ListStream;
+	typedef std::shared_ptr<ListStream> ListStream_ptr;
 
 	class ClientConnection : public std::enable_shared_from_this<ClientConnection>
 						   , private boost::noncopyable
 	{
 		const std::shared_ptr<DBManager> m_dbMgr;
+		const ServerLimits m_limits;
+		const MemoryBudget_ptr m_budget;
 
 		boost::asio::io_service& m_io;
 		boost::asio::ip::tcp::socket m_socket;
 		boost::asio::strand m_strand;
 		boost::asio::streambuf m_buf;
+		boost::asio::deadline_timer m_retryTimer;
+
+		bool m_reading;
+		bool m_closing;
+		size_t m_rxReserved;
+		std::string m_rejection;
+
+		Inflater m_inflater;
+		Deflater m_deflater;
+		bool m_compressReplies;
+
+		std::deque<std::string> m_outQueue;
+		size_t m_outBytes;
+		ListStream_ptr m_pendingList;
+		// Where the pending list comes from, locked for every chunk.
+		DB_ptr m_pendingListDB;
+
+		std::map<std::string, ChangeHub::Subscription_ptr> m_subscriptions;
+		std::map<std::string, ChangeNotice> m_pendingNotices;
+		boost::asio::deadline_timer m_noticeTimer;
+		bool m_noticeTimerArmed;
+
+		std::shared_ptr<ParseResult> m_parkedRequest;
+		ChangeHub::Subscription_ptr m_parkWatch;
+		boost::asio::deadline_timer m_parkTimer;
+		boost::posix_time::ptime m_parkDeadline;
 	public:
-		ClientConnection (boost::asio::io_service&, std::shared_ptr<DBManager>);
+		ClientConnection (boost::asio::io_service&, std::shared_ptr<DBManager>,
+				const ServerLimits&, MemoryBudget_ptr);
+		~ClientConnection ();
 
 		boost::asio::ip::tcp::socket& getSocket ();
 
 		void start ();
 	private:
+		void resumeRead ();
+		bool admitPacket (const std::string&);
+		void releaseReserved ();
+
 		void handleRead (const boost::system::error_code&, size_t);
+		void handlePacket (const std::string&);
+		void handleRequest (ParseResult&&);
+
+		void watchParked (DB_ptr);
+		bool park (ParseResult&&, int64_t waitMs);
+		void wakeParked ();
+
+		void writePacket (const PacketGenerator&);
+		void writeFront ();
+		void handleWrite (const boost::system::error_code&);
+
+		void writeListChunk ();
+
+		ChangeHub::Handler_t makeNoticeHandler ();
+		void queueNotice (const ChangeNotice&);
+		void scheduleNotices ();
+		void writeNotices ();
 
 		void writeErrorResponse (const std::string& reason, int code = -1);
+		void dropConnection ();
 	};
 
 	typedef std::shared_ptr<ClientConnection> ClientConnection_ptr;
@@ -27,24 +27,31 @@
  **********************************************************************/
 
 #include "db.h"
-#include <unordered_set>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <boost/uuid/random_generator.hpp>
+#include <boost/uuid/uuid_io.hpp>
 #include <mongo/client/dbclient.h>
+#include "blobhash.h"
 #include "itemmongo.h"
 
 namespace Laretz
 {
-	DBError::DBError (const std::string& reason)
-	: runtime_error (reason)
+	namespace
 	{
-	}
+		const std::string BlobStoreNs = "blobstore.";
+		const size_t BlobChunkSize = 1024 * 1024;
 
-	DBError::~DBError () noexcept
-	{
-	}
+		// Uploads not touched for that long are dropped with their chunks.
+		const long long UploadTtl = 24 * 60 * 60;
+		const unsigned long long MaxOpenUploads = 16;
 
-	namespace
-	{
-		void SetField (Item& item, const std::string& name, const mongo::BSONElement& elem)
+		// Per-field seqs of the last modification.
+		const char FieldSeqs [] = "_fseq";
+
+		void SetField (Item& item, const FieldName& name,
+				const mongo::BSONElement& elem, const std::shared_ptr<const mongo::BSONObj>& owner)
 		{
 			Field_t field;
 			switch (elem.type ())
@@ -71,17 +78,15 @@ namespace Laretz
 						continue;
 					strings.push_back (elem.String ());
 				}
-				field = strings;
+				field = std::move (strings);
 				break;
 			}
 			case mongo::BSONType::BinData:
 			{
 				int length = 0;
 				const char *data = elem.binData (length);
-				std::vector<char> vec;
-				vec.reserve (length);
-				std::copy (data, data + length, std::back_inserter (vec));
-				field = vec;
+				field = Blob (owner, data, length);
+				break;
 			}
 			default:
 			{
@@ -90,84 +95,314 @@ namespace Laretz
 			}
 			}
 
-			item [name] = field;
+			item [name] = std::move (field);
+		}
+
+		bool IsBlobRef (const mongo::BSONElement& elem)
+		{
+			return elem.type () == mongo::BSONType::Object &&
+					elem.embeddedObject ().hasField ("blobHash");
+		}
+
+		mongo::BSONObj MakeBlobRef (const std::string& hash, uint64_t size)
+		{
+			return BSON ("blobHash" << hash << "size" << static_cast<long long> (size));
+		}
+
+		// Blob fields that aren't in the item itself, like the field of a
+		// committed upload, are only known from the stored refs.
+		void AppendBlobSeqs (mongo::BSONObjBuilder& fieldSeqs, const std::string& prefix,
+				const Item& item, const mongo::BSONObj& blobs, uint64_t seq)
+		{
+			mongo::BSONObjIterator it { blobs };
+			while (it.more ())
+			{
+				const auto& elem = it.next ();
+				if (!item.find (elem.fieldName ()))
+					fieldSeqs << prefix + elem.fieldName () << static_cast<long long> (seq);
+			}
+		}
+
+		// Applies the update to the document with the given hash, creating it
+		// if there's none and upsert is set. Returns whether the document was
+		// there before. Hashes are unique, so of two racing upserts one fails
+		// with a duplicate key instead of inserting the document twice.
+		bool IncRefs (mongo::DBClientConnection& conn, const std::string& ns,
+				const std::string& hash, const mongo::BSONObj& update, bool upsert)
+		{
+			const auto& query = QUERY ("hash" << hash);
+			conn.update (ns, query, update, upsert);
+
+			const auto& status = conn.getLastErrorDetailed ();
+			const auto code = status ["code"].numberInt ();
+			if (upsert && (code == 11000 || code == 11001))
+			{
+				conn.update (ns, query, update);
+				return true;
+			}
+			return status ["updatedExisting"].trueValue ();
 		}
 	}
 
-	DB::DB (const std::string& m_dbName)
-	: m_dbPrefix ("user_" + m_dbName + '.')
-	, m_svcPrefix ("service_" + m_dbName + '.')
+	DB::DB (const std::string& dbName, ChangeHub_ptr hub, std::shared_ptr<boost::shared_mutex> mutex)
+	: m_dbName (dbName)
+	, m_dbPrefix ("user_" + dbName + '.')
+	, m_svcPrefix ("service_" + dbName + '.')
 	, m_conn (new mongo::DBClientConnection)
+	, m_hub (hub)
+	, m_mutex (mutex)
 	{
 		m_conn->connect ("localhost");
 
+		m_conn->ensureIndex (m_svcPrefix + "blobrefs", BSON ("hash" << 1), true);
+		m_conn->ensureIndex (BlobStoreNs + "blobs", BSON ("hash" << 1), true);
+		m_conn->ensureIndex (BlobStoreNs + "chunks", BSON ("blob" << 1 << "offset" << 1));
+
 		if (!m_conn->query (m_svcPrefix + "state", QUERY ("id" << "lastSeq"))->more ())
 			m_conn->insert (m_svcPrefix + "state",
 					BSON ("id" << "lastSeq" << "value" << static_cast<long long> (0)));
 	}
 
-	std::vector<Item> DB::enumerateItems (uint64_t after, const std::string& parent) const
+	void DB::ensureDigests ()
 	{
-		std::vector<Item> result;
+		if (m_conn->query (m_svcPrefix + "state", QUERY ("id" << "digests"))->more ())
+			return;
 
-		if (!parent.empty ())
-		{
-			if (!getParentId (parent))
-				throw UnknownParentError ("unknown parent for `" + parent + "`");
-			drainParent (result, after, parent);
-		}
-		else
+		rebuildDigests (std::string ());
+		m_conn->insert (m_svcPrefix + "state",
+				BSON ("id" << "digests" << "value" << 1));
+	}
+
+	boost::shared_mutex& DB::getMutex ()
+	{
+		return *m_mutex;
+	}
+
+	void DB::beginBatch ()
+	{
+		m_batchSeq = getSeqNum () + 1;
+	}
+
+	void DB::endBatch ()
+	{
+		m_batchSeq.reset ();
+
+		const auto releases = std::move (m_batchReleases);
+		m_batchReleases.clear ();
+		for (const auto& hash : releases)
+			releaseBlob (hash);
+	}
+
+	bool DB::hasItem (const std::string& id) const
+	{
+		return static_cast<bool> (getParentId (id));
+	}
+
+	std::vector<std::string> DB::getAncestors (const std::string& id) const
+	{
+		std::unordered_map<std::string, std::string> parentsCache;
+		return getAncestors (id, parentsCache);
+	}
+
+	std::vector<std::string> DB::getAncestors (const std::string& id,
+			std::unordered_map<std::string, std::string>& parentsCache) const
+	{
+		std::vector<std::string> chain;
+		auto current = id;
+		while (!current.empty ())
 		{
-			auto idCursor = m_conn->query (m_svcPrefix + "id2parent");
-			std::unordered_set<std::string> knownParents;
-			while (idCursor->more ());
-				knownParents.insert (idCursor->next () ["parentId"].String ());
+			auto pos = parentsCache.find (current);
+			if (pos == parentsCache.end ())
+			{
+				const auto& parent = getParentId (current);
+				if (!parent)
+					break;
+
+				pos = parentsCache.insert ({ current, *parent }).first;
+			}
 
-			for (const auto& parent : knownParents)
-				drainParent (result, after, parent);
+			current = pos->second;
+			chain.push_back (current);
 		}
-		return result;
+		return chain;
 	}
 
-	boost::optional<Item> DB::loadItem (const std::string& id)
+	std::unique_ptr<mongo::DBClientCursor> DB::queryChildren (const std::string& parent,
+			uint64_t after, uint64_t lastSeq, const std::string& lastId, const mongo::BSONObj *fields) const
 	{
-		const auto& parentId = getParentId (id);
-		if (!parentId)
-			return {};
+		mongo::BSONObjBuilder builder;
+		builder << "seq" << mongo::GT << static_cast<long long> (after) << "parentId" << parent;
+		if (!lastId.empty ())
+			builder << "$or" << BSON_ARRAY (BSON ("seq" << mongo::GT << static_cast<long long> (lastSeq)) <<
+					BSON ("seq" << static_cast<long long> (lastSeq) << "id" << mongo::GT << lastId));
+
+		auto query = mongo::Query (builder.obj ()).sort (BSON ("seq" << 1 << "id" << 1));
+		return std::unique_ptr<mongo::DBClientCursor> (m_conn->query (getNamespace (parent), query, 0, 0, fields).release ());
+	}
 
-		auto cursor = m_conn->query (getNamespace (*parentId), QUERY ("id" << id));
-		if (!cursor->more ())
+	boost::optional<Item> DB::loadItem (const std::string& id, bool blobRefs)
+	{
+		const auto& doc = loadDocument (id);
+		if (doc.isEmpty ())
 			return {};
 
-		const auto& obj = cursor->next ();
+		return makeItem (doc, blobRefs);
+	}
+
+	Item DB::makeItem (const mongo::BSONObj& doc, bool blobRefs) const
+	{
+		const auto owner = std::make_shared<const mongo::BSONObj> (doc.getOwned ());
+		const auto& obj = *owner;
 		Item item
 		{
-			id,
-			*parentId,
+			obj ["id"].String (),
+			obj.hasField ("parentId") ? obj ["parentId"].String () : std::string (),
 			static_cast<uint64_t> (obj ["seq"].Long ())
 		};
 
-		std::set<std::string> fieldNames;
-		obj.getFieldNames (fieldNames);
-		for (auto knownField : { "id", "parentId", "seq", "_id" })
-			fieldNames.erase (knownField);
+		static const FieldName knownFields [] = { "id", "parentId", "seq", "_id", FieldSeqs };
+
+		mongo::BSONObjIterator it { obj };
+		while (it.more ())
+		{
+			const auto& elem = it.next ();
+			const FieldName name { elem.fieldName () };
+			if (std::find (std::begin (knownFields), std::end (knownFields), name) != std::end (knownFields))
+				continue;
 
-		for (const auto& fieldName : fieldNames)
-			SetField (item, fieldName, obj [fieldName]);
+			if (!IsBlobRef (elem))
+			{
+				SetField (item, name, elem, owner);
+				continue;
+			}
+
+			const auto& ref = elem.embeddedObject ();
+			const auto& hash = ref ["blobHash"].String ();
+			const auto size = static_cast<uint64_t> (ref ["size"].Long ());
+			if (blobRefs)
+				item [name] = BlobRef { size, hash };
+			else
+				item [name] = loadBlob (hash, 0, size);
+		}
 
 		return item;
 	}
 
-	std::vector<Item> DB::enumerateRemoved (uint64_t after)
+	Blob DB::loadBlob (const std::string& hash, uint64_t offset, uint64_t length) const
+	{
+		const auto end = offset + length;
+		std::vector<char> data (length);
+
+		// Chunks stored before they had an end are checked below instead.
+		const auto& after = BSON_ARRAY (BSON ("end" << mongo::GT << static_cast<long long> (offset)) <<
+				BSON ("end" << BSON ("$exists" << false)));
+		auto cursor = m_conn->query (BlobStoreNs + "chunks",
+				mongo::Query (BSON ("blob" << hash
+						<< "offset" << mongo::LT << static_cast<long long> (end)
+						<< "$or" << after)).sort ("offset"));
+		uint64_t copied = 0;
+		while (cursor->more ())
+		{
+			const auto& chunk = cursor->next ();
+			const auto chunkOffset = static_cast<uint64_t> (chunk ["offset"].Long ());
+			int chunkLength = 0;
+			const char *chunkData = chunk ["data"].binData (chunkLength);
+			if (chunkOffset + chunkLength <= offset)
+				continue;
+
+			const auto from = std::max (chunkOffset, offset);
+			const auto to = std::min<uint64_t> (chunkOffset + chunkLength, end);
+			std::memcpy (data.data () + (from - offset), chunkData + (from - chunkOffset), to - from);
+			copied += to - from;
+		}
+
+		if (copied != length)
+			throw DBError ("blob " + hash + " is missing chunks");
+
+		return Blob (std::move (data));
+	}
+
+	std::unique_ptr<mongo::DBClientCursor> DB::queryRemoved (uint64_t after,
+			uint64_t lastSeq, const std::string& lastId) const
 	{
+		mongo::BSONObjBuilder builder;
+		builder << "seq" << mongo::GT << static_cast<long long> (after);
+		if (!lastId.empty ())
+			builder << "$or" << BSON_ARRAY (BSON ("seq" << mongo::GT << static_cast<long long> (lastSeq)) <<
+					BSON ("seq" << static_cast<long long> (lastSeq) << "id" << mongo::GT << lastId));
+
+		auto query = mongo::Query (builder.obj ()).sort (BSON ("seq" << 1 << "id" << 1));
+		return std::unique_ptr<mongo::DBClientCursor> (m_conn->query (m_svcPrefix + "removed", query).release ());
+	}
+
+	std::vector<Item> DB::listChildren (const std::string& parentId) const
+	{
+		static const auto fields = BSON ("id" << 1 << "seq" << 1);
+
 		std::vector<Item> result;
+		auto cursor = queryChildren (parentId, 0, 0, std::string (), &fields);
+		while (cursor->more ())
+		{
+			const auto& obj = cursor->next ();
+			result.push_back ({ obj ["id"].String (), parentId, static_cast<uint64_t> (obj ["seq"].Long ()) });
+		}
+		return result;
+	}
+
+	boost::optional<std::vector<std::string>> DB::getChangedFields (const std::string& id, uint64_t after) const
+	{
+		const auto& doc = loadDocument (id);
+		if (doc.isEmpty () || !doc.hasField (FieldSeqs))
+			return {};
+
+		const auto& seqs = doc [FieldSeqs].embeddedObject ();
+
+		std::vector<std::string> result;
+		mongo::BSONObjIterator it { doc };
+		while (it.more ())
+		{
+			const auto& elem = it.next ();
+			const std::string name { elem.fieldName () };
+			if (name == "id" || name == "parentId" || name == "seq" || name == "_id" || name == FieldSeqs)
+				continue;
+
+			if (!seqs.hasField (name.c_str ()))
+				return {};
+
+			if (static_cast<uint64_t> (seqs [name].Long ()) > after)
+				result.push_back (name);
+		}
+
+		return result;
+	}
+
+	SubtreeDigest DB::getDigest (const std::string& parentId) const
+	{
+		const auto& digests = getDigests ({ parentId });
+		const auto pos = digests.find (parentId);
+		return pos != digests.end () ? pos->second : SubtreeDigest ();
+	}
 
-		auto cursor = m_conn->query (m_svcPrefix + "removed",
-				QUERY ("seq" << mongo::GT << boost::lexical_cast<std::string> (after)));
+	std::unordered_map<std::string, SubtreeDigest> DB::getDigests (const std::vector<std::string>& parentIds) const
+	{
+		std::unordered_map<std::string, SubtreeDigest> result;
+		if (parentIds.empty ())
+			return result;
+
+		mongo::BSONArrayBuilder ids;
+		for (const auto& id : parentIds)
+			ids.append (id);
+
+		auto cursor = m_conn->query (m_svcPrefix + "digests",
+				QUERY ("parent" << BSON ("$in" << ids.arr ())));
 		while (cursor->more ())
 		{
 			const auto& obj = cursor->next ();
-			result.push_back ({ obj ["id"].String (), static_cast<uint64_t> (obj ["seq"].Long ()) });
+			result [obj ["parent"].String ()] =
+			{
+				static_cast<uint64_t> (obj ["digest"].Long ()),
+				static_cast<uint64_t> (obj ["count"].Long ())
+			};
 		}
 
 		return result;
@@ -201,10 +436,12 @@ namespace Laretz
 		if (!parentId)
 			throw DBError ("cannot increment sequence number: unknown parent id for " + id);
 
-		const auto newSeq = getSeqNum () + 1;
+		const auto oldSeq = getSeqNum (id);
+		const auto newSeq = nextSeqNum ();
 		m_conn->update (getNamespace (*parentId),
 				QUERY ("id" << id),
 				BSON ("$set" << BSON ("seq" << static_cast<long long> (newSeq))));
+		updateDigests (id, *parentId, oldSeq, newSeq);
 		m_conn->update (m_svcPrefix + "state",
 				QUERY ("id" << "lastSeq"),
 				BSON ("id" << "lastSeq"
@@ -214,35 +451,20 @@ namespace Laretz
 		return newSeq;
 	}
 
-	uint64_t DB::addItem (Item item)
+	uint64_t DB::addItem (const Item& item)
 	{
-		const auto& newSeq = getSeqNum () + 1;
-		item.setSeq (newSeq);
-
-		const auto& ns = getNamespace (item.getParentId ());
-		std::cout << "adding " << item.getId () << " seq " << newSeq << " to " << ns << std::endl;
-
-		m_conn->insert (ns, toBSON (item, true));
-		m_conn->insert (m_svcPrefix + "id2parent",
-				BSON ("id" << item.getId ()
-					<< "parentId" << item.getParentId ()));
-		m_conn->update (m_svcPrefix + "state",
-				QUERY ("id" << "lastSeq"),
-				BSON ("id" << "lastSeq"
-						<< "value" << static_cast<long long> (newSeq)));
-
-		setChildSeqNum (item.getParentId (), newSeq);
-		return newSeq;
+		Item stored { item };
+		const auto& blobs = storeBlobs (stored, mongo::BSONObj ());
+		return insertItem (stored, blobs);
 	}
 
 	uint64_t DB::modifyItem (const Item& item)
 	{
-		m_conn->update (getNamespace (item.getParentId ()),
-				QUERY ("id" << item.getId ()),
-				BSON ("$set" << toBSON (item)));
-		const auto newSeq = incSeqNum (item.getId ());
-		setChildSeqNum (item.getParentId (), newSeq);
-		return newSeq;
+		const auto& old = loadDocument (item.getId ());
+
+		Item stored { item };
+		const auto& blobs = storeBlobs (stored, old);
+		return updateItem (stored, blobs, old);
 	}
 
 	uint64_t DB::removeItem (const std::string& id)
@@ -251,17 +473,157 @@ namespace Laretz
 		if (!parent)
 			throw std::runtime_error ("unable to find parent item for " + id + " on removal");
 
+		const auto& doc = loadDocument (id);
+		releaseBlobs (doc, [] (const FieldName&) { return true; });
+
 		m_conn->remove (getNamespace (*parent),
 				QUERY ("id" << id));
-		const auto newSeq = getSeqNum () + 1;
+		if (!doc.isEmpty ())
+			updateDigests (id, *parent, doc ["seq"].Long (), 0, getDigest (id));
+
+		const auto newSeq = nextSeqNum ();
+		m_conn->update (m_svcPrefix + "state",
+				QUERY ("id" << "lastSeq"),
+				BSON ("id" << "lastSeq"
+						<< "value" << static_cast<long long> (newSeq)));
 		setChildSeqNum (*parent, newSeq);
 
 		m_conn->remove (m_svcPrefix + "id2parent", QUERY ("id" << id));
 		m_conn->insert (m_svcPrefix + "removed", BSON ("id" << id << "seq" << static_cast<long long> (newSeq)));
 
+		notify (OpType::Delete, id, *parent, newSeq);
 		return newSeq;
 	}
 
+	uint64_t DB::stageBlobChunk (const std::string& id, const std::string& upload,
+			uint64_t offset, const Blob& data)
+	{
+		const auto& ns = m_svcPrefix + "uploads";
+		auto state = m_conn->findOne (ns, QUERY ("upload" << upload));
+		if (state.isEmpty ())
+		{
+			sweepUploads ();
+			if (m_conn->count (ns, BSON ("committed" << BSON ("$exists" << false))) >= MaxOpenUploads)
+				throw DBError ("too many unfinished uploads");
+
+			state = BSON ("upload" << upload
+					<< "id" << id
+					<< "blob" << boost::uuids::to_string (boost::uuids::random_generator () ())
+					<< "size" << 0LL
+					<< "count" << 0LL
+					<< "touched" << static_cast<long long> (std::time (nullptr)));
+			m_conn->insert (ns, state);
+		}
+		else if (state ["id"].String () != id)
+			throw DBError ("upload " + upload + " belongs to another item");
+
+		const auto size = static_cast<uint64_t> (state ["size"].Long ());
+		if (state.hasField ("committed") || offset != size || data.empty ())
+			return size;
+
+		const auto count = state ["count"].Long ();
+
+		mongo::BSONObjBuilder chunk;
+		chunk << "blob" << state ["blob"].String ()
+				<< "n" << count
+				<< "offset" << static_cast<long long> (offset)
+				<< "end" << static_cast<long long> (offset + data.size ());
+		chunk.appendBinData ("data", data.size (), mongo::BinDataGeneral, data.data ());
+		m_conn->insert (BlobStoreNs + "chunks", chunk.obj ());
+
+		const auto newSize = size + data.size ();
+		m_conn->update (ns,
+				QUERY ("upload" << upload),
+				BSON ("$set" << BSON ("size" << static_cast<long long> (newSize)
+						<< "count" << count + 1
+						<< "touched" << static_cast<long long> (std::time (nullptr)))));
+		return newSize;
+	}
+
+	uint64_t DB::commitUpload (const Item& item, const std::string& field, const std::string& upload)
+	{
+		const auto& ns = m_svcPrefix + "uploads";
+		const auto& state = m_conn->findOne (ns, QUERY ("upload" << upload));
+		if (state.isEmpty () || state ["id"].String () != item.getId ())
+			throw DBError ("unknown upload " + upload + " for " + item.getId ());
+		if (state.hasField ("committed"))
+			return state ["committed"].Long ();
+
+		const auto& staged = state ["blob"].String ();
+		const auto size = static_cast<uint64_t> (state ["size"].Long ());
+
+		ContentHasher hasher;
+		auto cursor = m_conn->query (BlobStoreNs + "chunks",
+				mongo::Query (BSON ("blob" << staged)).sort ("n"));
+		while (cursor->more ())
+		{
+			const auto& chunk = cursor->next ();
+			int length = 0;
+			const char *data = chunk ["data"].binData (length);
+			hasher.update (data, length);
+		}
+		const auto& hash = hasher.finish ();
+
+		addBlobRef (hash, size,
+				[this, &staged, &hash]
+				{
+					m_conn->update (BlobStoreNs + "chunks",
+							QUERY ("blob" << staged),
+							BSON ("$set" << BSON ("blob" << hash)),
+							false, true);
+				});
+		m_conn->remove (BlobStoreNs + "chunks", QUERY ("blob" << staged));
+
+		const auto& old = loadDocument (item.getId ());
+
+		Item stored { item };
+		mongo::BSONObjBuilder blobs;
+		blobs.appendElements (storeBlobs (stored, old));
+		blobs.append (field, MakeBlobRef (hash, size));
+
+		const auto newSeq = old.isEmpty () ?
+				insertItem (stored, blobs.obj ()) :
+				updateItem (stored, blobs.obj (), old);
+
+		m_conn->update (ns,
+				QUERY ("upload" << upload),
+				BSON ("$set" << BSON ("committed" << static_cast<long long> (newSeq)
+						<< "touched" << static_cast<long long> (std::time (nullptr)))));
+		return newSeq;
+	}
+
+	boost::optional<uint64_t> DB::getCommittedUpload (const std::string& id, const std::string& upload)
+	{
+		const auto& state = m_conn->findOne (m_svcPrefix + "uploads", QUERY ("upload" << upload));
+		if (state.isEmpty () || !state.hasField ("committed") || state ["id"].String () != id)
+			return {};
+
+		return static_cast<uint64_t> (state ["committed"].Long ());
+	}
+
+	void DB::sweepUploads ()
+	{
+		const auto& ns = m_svcPrefix + "uploads";
+		const auto cutoff = static_cast<long long> (std::time (nullptr)) - UploadTtl;
+		const auto& expired = BSON ("$or" << BSON_ARRAY (BSON ("touched" << mongo::LT << cutoff) <<
+					BSON ("touched" << BSON ("$exists" << false))));
+
+		auto cursor = m_conn->query (ns, expired);
+		while (cursor->more ())
+		{
+			const auto& state = cursor->next ();
+			if (!state.hasField ("committed"))
+				m_conn->remove (BlobStoreNs + "chunks", QUERY ("blob" << state ["blob"].String ()));
+		}
+		m_conn->remove (ns, expired);
+	}
+
+	ChangeHub::Subscription_ptr DB::subscribe (const std::string& parentId, bool subtree,
+			const ChangeHub::Handler_t& handler)
+	{
+		return m_hub->subscribe (m_dbName, parentId, subtree, handler);
+	}
+
 	boost::optional<std::string> DB::getParentId (const std::string& id) const
 	{
 		auto idCursor = m_conn->query (m_svcPrefix + "id2parent", QUERY ("id" << id));
@@ -276,18 +638,9 @@ namespace Laretz
 		return m_dbPrefix + (!parentId.empty () ? parentId : "root");
 	}
 
-	void DB::drainParent (std::vector<Item>& result, uint64_t after, const std::string& parent) const
+	uint64_t DB::nextSeqNum ()
 	{
-		auto cursor = m_conn->query (getNamespace (parent),
-				QUERY ("seq" << mongo::GT << static_cast<long long> (after) << "parentId" << parent));
-		while (cursor->more ())
-		{
-			const auto& obj = cursor->next ();
-			const auto& id = obj ["id"].String ();
-			result.push_back ({ id, static_cast<uint64_t> (obj ["seq"].Long ()) });
-
-			drainParent (result, after, id);
-		}
+		return m_batchSeq ? *m_batchSeq : getSeqNum () + 1;
 	}
 
 	void DB::setChildSeqNum (const std::string& id, uint64_t newSeq)
@@ -299,8 +652,240 @@ namespace Laretz
 		if (!parentId)
 			throw std::runtime_error ("unable to increment seq counter");
 
-		m_conn->update (getNamespace (*parentId),
+		const auto& ns = getNamespace (*parentId);
+		const auto& old = m_conn->findOne (ns, QUERY ("id" << id));
+		m_conn->update (ns,
 				QUERY ("id" << id),
 				BSON ("$set" << BSON ("seq" << static_cast<long long> (newSeq))));
+		if (!old.isEmpty ())
+			updateDigests (id, *parentId, old ["seq"].Long (), newSeq);
+	}
+
+	void DB::updateDigests (const std::string& id, const std::string& parentId, uint64_t oldSeq, uint64_t newSeq,
+			const SubtreeDigest& subtree)
+	{
+		if (oldSeq == newSeq)
+			return;
+
+		const auto& change = DigestChange (id, oldSeq, newSeq, subtree);
+
+		// The chain of a non-root parent already ends with the root.
+		auto chain = getAncestors (parentId);
+		chain.insert (chain.begin (), parentId);
+		for (const auto& ancestor : chain)
+			m_conn->update (m_svcPrefix + "digests",
+					QUERY ("parent" << ancestor),
+					BSON ("$bit" << BSON ("digest" << BSON ("xor" << static_cast<long long> (change.m_digest))) <<
+							"$inc" << BSON ("count" << static_cast<long long> (change.m_count))),
+					true);
+	}
+
+	SubtreeDigest DB::rebuildDigests (const std::string& parentId)
+	{
+		static const auto fields = BSON ("id" << 1 << "seq" << 1);
+
+		SubtreeDigest digest;
+		auto cursor = queryChildren (parentId, 0, 0, std::string (), &fields);
+		while (cursor->more ())
+		{
+			const auto& obj = cursor->next ();
+			const auto& id = obj ["id"].String ();
+			digest.add (id, obj ["seq"].Long ());
+			digest += rebuildDigests (id);
+		}
+
+		m_conn->update (m_svcPrefix + "digests",
+				QUERY ("parent" << parentId),
+				BSON ("parent" << parentId
+						<< "digest" << static_cast<long long> (digest.m_digest)
+						<< "count" << static_cast<long long> (digest.m_count)),
+				true);
+		return digest;
+	}
+
+	void DB::notify (OpType type, const std::string& id, const std::string& parentId, uint64_t seq)
+	{
+		if (!m_hub->hasSubscribers (m_dbName))
+			return;
+
+		m_hub->publish (m_dbName, { id, parentId, seq, type },
+				[this, &parentId] { return getAncestors (parentId); });
+	}
+
+	mongo::BSONObj DB::loadDocument (const std::string& id) const
+	{
+		const auto& parentId = getParentId (id);
+		if (!parentId)
+			return {};
+
+		return m_conn->findOne (getNamespace (*parentId), QUERY ("id" << id));
+	}
+
+	uint64_t DB::insertItem (const Item& item, const mongo::BSONObj& blobs)
+	{
+		const auto newSeq = nextSeqNum ();
+
+		const auto& ns = getNamespace (item.getParentId ());
+		std::cout << "adding " << item.getId () << " seq " << newSeq << " to " << ns << std::endl;
+
+		mongo::BSONObjBuilder fieldSeqs;
+		for (const auto& field : item)
+			fieldSeqs << field.first.str () << static_cast<long long> (newSeq);
+		AppendBlobSeqs (fieldSeqs, std::string (), item, blobs, newSeq);
+
+		mongo::BSONObjBuilder builder;
+		builder.appendElements (toBSON (item, newSeq));
+		builder.appendElements (blobs);
+		builder << FieldSeqs << fieldSeqs.obj ();
+		m_conn->insert (ns, builder.obj ());
+		m_conn->insert (m_svcPrefix + "id2parent",
+				BSON ("id" << item.getId ()
+					<< "parentId" << item.getParentId ()));
+		m_conn->update (m_svcPrefix + "state",
+				QUERY ("id" << "lastSeq"),
+				BSON ("id" << "lastSeq"
+						<< "value" << static_cast<long long> (newSeq)));
+		updateDigests (item.getId (), item.getParentId (), 0, newSeq);
+
+		setChildSeqNum (item.getParentId (), newSeq);
+		notify (OpType::Append, item.getId (), item.getParentId (), newSeq);
+		return newSeq;
+	}
+
+	uint64_t DB::updateItem (const Item& item, const mongo::BSONObj& blobs, const mongo::BSONObj& old)
+	{
+		releaseBlobs (old,
+				[&item, &blobs] (const FieldName& name)
+				{
+					const auto field = item.find (name);
+					return (field && !boost::get<BlobRef> (field)) || blobs.hasField (name.str ().c_str ());
+				});
+
+		mongo::BSONObjBuilder builder;
+		builder.appendElements (toBSON (item));
+		builder.appendElements (blobs);
+		m_conn->update (getNamespace (item.getParentId ()),
+				QUERY ("id" << item.getId ()),
+				BSON ("$set" << builder.obj ()));
+		const auto newSeq = incSeqNum (item.getId ());
+
+		// References the client has sent back leave the field as it is.
+		mongo::BSONObjBuilder fieldSeqs;
+		for (const auto& field : item)
+			if (!boost::get<BlobRef> (&field.second) || blobs.hasField (field.first.str ().c_str ()))
+				fieldSeqs << std::string (FieldSeqs) + '.' + field.first.str () << static_cast<long long> (newSeq);
+		AppendBlobSeqs (fieldSeqs, std::string (FieldSeqs) + '.', item, blobs, newSeq);
+		const auto& fieldSeqsObj = fieldSeqs.obj ();
+		if (!fieldSeqsObj.isEmpty ())
+			m_conn->update (getNamespace (item.getParentId ()),
+					QUERY ("id" << item.getId ()),
+					BSON ("$set" << fieldSeqsObj));
+
+		setChildSeqNum (item.getParentId (), newSeq);
+		notify (OpType::Modify, item.getId (), item.getParentId (), newSeq);
+		return newSeq;
+	}
+
+	mongo::BSONObj DB::storeBlobs (Item& item, const mongo::BSONObj& old)
+	{
+		mongo::BSONObjBuilder refs;
+		for (auto& field : item)
+		{
+			const auto& name = field.first.str ();
+			if (const auto blob = boost::get<Blob> (&field.second))
+			{
+				const auto& hash = ContentHash (*blob);
+				addBlobRef (hash, blob->size (),
+						[this, &hash, blob] { writeBlobChunks (hash, *blob); });
+
+				refs.append (name, MakeBlobRef (hash, blob->size ()));
+				BlobRef ref { blob->size (), hash };
+				field.second = std::move (ref);
+			}
+			else if (const auto ref = boost::get<BlobRef> (&field.second))
+			{
+				const auto& oldElem = old.getField (name);
+				if (IsBlobRef (oldElem) && oldElem.embeddedObject () ["blobHash"].String () == ref->getHash ())
+					continue;
+
+				if (!addBlobRef (ref->getHash ()))
+					throw DBError ("unknown blob " + ref->getHash () + " for field " + name);
+
+				const auto& meta = m_conn->findOne (BlobStoreNs + "blobs", QUERY ("hash" << ref->getHash ()));
+				refs.append (name, MakeBlobRef (ref->getHash (), meta ["size"].Long ()));
+			}
+		}
+		return refs.obj ();
+	}
+
+	void DB::writeBlobChunks (const std::string& key, const Blob& blob)
+	{
+		for (size_t offset = 0, n = 0; offset < blob.size (); offset += BlobChunkSize, ++n)
+		{
+			const auto length = std::min (BlobChunkSize, blob.size () - offset);
+
+			mongo::BSONObjBuilder chunk;
+			chunk << "blob" << key
+					<< "n" << static_cast<long long> (n)
+					<< "offset" << static_cast<long long> (offset)
+					<< "end" << static_cast<long long> (offset + length);
+			chunk.appendBinData ("data", length, mongo::BinDataGeneral, blob.data () + offset);
+			m_conn->insert (BlobStoreNs + "chunks", chunk.obj ());
+		}
+	}
+
+	bool DB::addBlobRef (const std::string& hash)
+	{
+		return IncRefs (*m_conn, m_svcPrefix + "blobrefs", hash, BSON ("$inc" << BSON ("refs" << 1)), false);
+	}
+
+	void DB::addBlobRef (const std::string& hash, uint64_t size, const std::function<void ()>& storeChunks)
+	{
+		if (IncRefs (*m_conn, m_svcPrefix + "blobrefs", hash, BSON ("$inc" << BSON ("refs" << 1)), true))
+			return;
+
+		const auto& users = BSON ("$inc" << BSON ("users" << 1) <<
+				"$set" << BSON ("size" << static_cast<long long> (size)));
+		if (!IncRefs (*m_conn, BlobStoreNs + "blobs", hash, users, true))
+			storeChunks ();
+	}
+
+	bool DB::holdsBlob (const std::string& hash) const
+	{
+		return !m_conn->findOne (m_svcPrefix + "blobrefs", QUERY ("hash" << hash)).isEmpty ();
+	}
+
+	void DB::releaseBlob (const std::string& hash)
+	{
+		if (m_batchSeq)
+		{
+			m_batchReleases.push_back (hash);
+			return;
+		}
+
+		const auto& refsNs = m_svcPrefix + "blobrefs";
+		m_conn->update (refsNs, QUERY ("hash" << hash), BSON ("$inc" << BSON ("refs" << -1)));
+		if (!m_conn->findOne (refsNs, QUERY ("hash" << hash << "refs" << mongo::GT << 0)).isEmpty ())
+			return;
+		m_conn->remove (refsNs, QUERY ("hash" << hash));
+
+		const auto& ns = BlobStoreNs + "blobs";
+		m_conn->update (ns, QUERY ("hash" << hash), BSON ("$inc" << BSON ("users" << -1)));
+		if (!m_conn->findOne (ns, QUERY ("hash" << hash << "users" << mongo::GT << 0)).isEmpty ())
+			return;
+
+		m_conn->remove (ns, QUERY ("hash" << hash));
+		m_conn->remove (BlobStoreNs + "chunks", QUERY ("blob" << hash));
+	}
+
+	void DB::releaseBlobs (const mongo::BSONObj& old, const std::function<bool (const FieldName&)>& replaced)
+	{
+		mongo::BSONObjIterator it { old };
+		while (it.more ())
+		{
+			const auto& elem = it.next ();
+			if (IsBlobRef (elem) && replaced (elem.fieldName ()))
+				releaseBlob (elem.embeddedObject () ["blobHash"].String ());
+		}
 	}
 }
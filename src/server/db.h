@@ -31,69 +31,118 @@
 #include <memory>
 #include <unordered_map>
 #include <string>
-#include <stdexcept>
-#include <mutex>
+#include <functional>
 #include <boost/optional.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include "operation.h"
 #include "item.h"
+#include "digest.h"
+#include "changehub.h"
+#include "dberror.h"
 
 namespace mongo
 {
+	class BSONObj;
 	class DBClientConnection;
+	class DBClientCursor;
 }
 
 namespace Laretz
 {
-	class DBError : public std::runtime_error
-	{
-	public:
-		DBError (const std::string&);
-		~DBError () noexcept;
-	};
-
-	class UnknownParentError : public DBError
-	{
-	public:
-		UnknownParentError (const std::string& msg)
-		: DBError (msg)
-		{
-		}
-
-		~UnknownParentError () noexcept
-		{
-		}
-	};
-
 	class DB
 	{
+		const std::string m_dbName;
 		const std::string m_dbPrefix;
 		const std::string m_svcPrefix;
 		const std::shared_ptr<mongo::DBClientConnection> m_conn;
+		const ChangeHub_ptr m_hub;
+		const std::shared_ptr<boost::shared_mutex> m_mutex;
 
-		std::mutex m_mutex;
+		boost::optional<uint64_t> m_batchSeq;
+		std::vector<std::string> m_batchReleases;
 	public:
-		DB (const std::string&);
+		DB (const std::string&, ChangeHub_ptr, std::shared_ptr<boost::shared_mutex>);
+
+		// Shared by all the DB objects of the same user.
+		boost::shared_mutex& getMutex ();
 
-		std::mutex& getMutex ();
+		// Builds the subtree digests of a database that predates them.
+		// Must be called with the mutex locked exclusively.
+		void ensureDigests ();
 
-		std::vector<Item> enumerateItems (uint64_t after = 0, const std::string& parentId = std::string ()) const;
-		boost::optional<Item> loadItem (const std::string& id);
+		// Everything written until endBatch() gets the same seq. Blobs
+		// aren't released until then either, so a blob the user holds when
+		// a batch starts stays there for all of its operations.
+		void beginBatch ();
+		void endBatch ();
 
-		std::vector<Item> enumerateRemoved (uint64_t after = 0);
+		bool hasItem (const std::string& id) const;
+		bool holdsBlob (const std::string& hash) const;
+		std::vector<std::string> getAncestors (const std::string& id) const;
+		std::vector<std::string> getAncestors (const std::string& id,
+				std::unordered_map<std::string, std::string>& parentsCache) const;
+		std::unique_ptr<mongo::DBClientCursor> queryChildren (const std::string& parentId, uint64_t after,
+				uint64_t lastSeq = 0, const std::string& lastId = std::string (),
+				const mongo::BSONObj *fields = nullptr) const;
+		boost::optional<Item> loadItem (const std::string& id, bool blobRefs = false);
+		Item makeItem (const mongo::BSONObj&, bool blobRefs = false) const;
+		Blob loadBlob (const std::string& hash, uint64_t offset, uint64_t length) const;
+
+		std::unique_ptr<mongo::DBClientCursor> queryRemoved (uint64_t after,
+				uint64_t lastSeq = 0, const std::string& lastId = std::string ()) const;
+
+		// Names of the fields of the item modified after the given seq, or
+		// nothing if that isn't known for some of its fields.
+		boost::optional<std::vector<std::string>> getChangedFields (const std::string& id, uint64_t after) const;
+
+		std::vector<Item> listChildren (const std::string& parentId) const;
+		SubtreeDigest getDigest (const std::string& parentId) const;
+		std::unordered_map<std::string, SubtreeDigest> getDigests (const std::vector<std::string>& parentIds) const;
 
 		uint64_t getSeqNum (const std::string& id);
 		uint64_t getSeqNum ();
 		uint64_t incSeqNum (const std::string& id);
 
-		uint64_t addItem (Item);
+		uint64_t addItem (const Item&);
 		uint64_t modifyItem (const Item&);
 		uint64_t removeItem (const std::string& id);
+
+		uint64_t stageBlobChunk (const std::string& id, const std::string& upload,
+				uint64_t offset, const Blob& data);
+		uint64_t commitUpload (const Item&, const std::string& field, const std::string& upload);
+
+		// The seq an upload has been committed with, if it has. Committed
+		// uploads are remembered for a while so that a retried final chunk
+		// gets the same answer instead of starting a new upload.
+		boost::optional<uint64_t> getCommittedUpload (const std::string& id, const std::string& upload);
+
+		ChangeHub::Subscription_ptr subscribe (const std::string& parentId, bool subtree,
+				const ChangeHub::Handler_t&);
 	private:
 		boost::optional<std::string> getParentId (const std::string&) const;
 		std::string getNamespace (const std::string&) const;
 
-		void drainParent (std::vector<Item>&, uint64_t, const std::string&) const;
+		mongo::BSONObj loadDocument (const std::string& id) const;
+		void sweepUploads ();
+
+		uint64_t insertItem (const Item&, const mongo::BSONObj& blobs);
+		uint64_t updateItem (const Item&, const mongo::BSONObj& blobs, const mongo::BSONObj& old);
 
+		mongo::BSONObj storeBlobs (Item&, const mongo::BSONObj& old);
+		void writeBlobChunks (const std::string& key, const Blob&);
+		// Adds a ref to a blob the user already holds, returns false if none.
+		bool addBlobRef (const std::string& hash);
+		// Adds a ref to the blob, calling storeChunks if nobody has it yet.
+		void addBlobRef (const std::string& hash, uint64_t size, const std::function<void ()>& storeChunks);
+		void releaseBlob (const std::string& hash);
+		void releaseBlobs (const mongo::BSONObj& old, const std::function<bool (const FieldName&)>& replaced);
+
+		uint64_t nextSeqNum ();
 		void setChildSeqNum (const std::string& parentId, uint64_t);
+
+		void updateDigests (const std::string& id, const std::string& parentId, uint64_t oldSeq, uint64_t newSeq,
+				const SubtreeDigest& subtree = SubtreeDigest ());
+		SubtreeDigest rebuildDigests (const std::string& parentId);
+		void notify (OpType, const std::string& id, const std::string& parentId, uint64_t seq);
 	};
 }
@@ -0,0 +1,105 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#include "dblistsource.h"
+#include <mongo/client/dbclient.h>
+#include "blobhash.h"
+#include "db.h"
+
+namespace Laretz
+{
+	namespace
+	{
+		class DBCursor : public ListSource::Cursor
+		{
+			const DB_ptr m_db;
+			const std::unique_ptr<mongo::DBClientCursor> m_cursor;
+			const bool m_bodies;
+		public:
+			DBCursor (DB_ptr db, std::unique_ptr<mongo::DBClientCursor> cursor, bool bodies)
+			: m_db (db)
+			, m_cursor (std::move (cursor))
+			, m_bodies (bodies)
+			{
+			}
+
+			bool more ()
+			{
+				return m_cursor->more ();
+			}
+
+			Item next ()
+			{
+				const auto& obj = m_cursor->next ();
+				if (!m_bodies)
+					return { obj ["id"].String (), static_cast<uint64_t> (obj ["seq"].Long ()) };
+
+				auto item = m_db->makeItem (obj, true);
+				ReplaceBlobsWithRefs (item);
+				return item;
+			}
+		};
+	}
+
+	DBListSource::DBListSource (DB_ptr db, const ListBodyOptions& bodyOptions)
+	: m_db (db)
+	, m_bodies (bodyOptions.m_enabled)
+	{
+		if (!m_bodies || !bodyOptions.m_fields.empty ())
+		{
+			mongo::BSONObjBuilder projection;
+			projection << "id" << 1 << "seq" << 1;
+			if (m_bodies)
+			{
+				projection << "parentId" << 1;
+				for (const auto& field : bodyOptions.m_fields)
+					if (field != "id" && field != "seq" && field != "parentId")
+						projection << field << 1;
+			}
+			m_projection = std::make_shared<mongo::BSONObj> (projection.obj ());
+		}
+	}
+
+	bool DBListSource::hasItem (const std::string& id) const
+	{
+		return m_db->hasItem (id);
+	}
+
+	ListSource::Cursor_ptr DBListSource::queryChildren (const std::string& parentId, uint64_t after,
+			uint64_t lastSeq, const std::string& lastId) const
+	{
+		auto cursor = m_db->queryChildren (parentId, after, lastSeq, lastId, m_projection.get ());
+		return Cursor_ptr (new DBCursor (m_db, std::move (cursor), m_bodies));
+	}
+
+	ListSource::Cursor_ptr DBListSource::queryRemoved (uint64_t after,
+			uint64_t lastSeq, const std::string& lastId) const
+	{
+		return Cursor_ptr (new DBCursor (m_db, m_db->queryRemoved (after, lastSeq, lastId), false));
+	}
+}
@@ -27,11 +27,14 @@
  **********************************************************************/
 
 #include "dbmanager.h"
+#include <boost/thread/locks.hpp>
 #include "db.h"
+#include "changehub.h"
 
 namespace Laretz
 {
 	DBManager::DBManager ()
+	: m_hub (std::make_shared<ChangeHub> ())
 	{
 		m_conn.connect ("localhost");
 	}
@@ -46,6 +49,31 @@ namespace Laretz
 		auto obj = cursor->next ();
 		const std::string dbName { obj.getStringField ("db") };
 
-		return DB_ptr (new DB (dbName));
+		std::shared_ptr<boost::shared_mutex> mutex;
+		bool digestsReady = false;
+		{
+			std::lock_guard<std::mutex> guard { m_usersGuard };
+			auto& state = m_users [dbName];
+			if (!state.m_mutex)
+				state.m_mutex = std::make_shared<boost::shared_mutex> ();
+			mutex = state.m_mutex;
+			digestsReady = state.m_digestsReady;
+		}
+
+		DB_ptr db { new DB (dbName, m_hub, mutex) };
+
+		// No request gets the database until its digests are there. If
+		// building them fails, the next request tries again.
+		if (!digestsReady)
+		{
+			{
+				boost::unique_lock<boost::shared_mutex> lock { *mutex };
+				db->ensureDigests ();
+			}
+
+			std::lock_guard<std::mutex> guard { m_usersGuard };
+			m_users [dbName].m_digestsReady = true;
+		}
+		return db;
 	}
 }
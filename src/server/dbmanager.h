@@ -30,6 +30,9 @@
 
 #include <memory>
 #include <string>
+#include <mutex>
+#include <unordered_map>
+#include <boost/thread/shared_mutex.hpp>
 #include <mongo/client/dbclientinterface.h>
 
 namespace Laretz
@@ -43,9 +46,21 @@ namespace Laretz
 		std::string m_password;
 	};
 
+	class ChangeHub;
+
 	class DBManager
 	{
 		mongo::DBClientConnection m_conn;
+		const std::shared_ptr<ChangeHub> m_hub;
+
+		struct UserState
+		{
+			std::shared_ptr<boost::shared_mutex> m_mutex;
+			bool m_digestsReady = false;
+		};
+
+		std::mutex m_usersGuard;
+		std::unordered_map<std::string, UserState> m_users;
 	public:
 		DBManager ();
 
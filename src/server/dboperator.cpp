@@ -27,12 +27,72 @@
  **********************************************************************/
 
 #include "dboperator.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
 #include <boost/lexical_cast.hpp>
+#include "blobhash.h"
 #include "db.h"
+#include "dblistsource.h"
+#include "liststream.h"
 #include "operation.h"
 
 namespace Laretz
 {
+	namespace
+	{
+		const int64_t MaxBlobRange = 4 * 1024 * 1024;
+
+		template<typename T>
+		T GetParam (const Item& item, const FieldName& name, const T& def = T ())
+		{
+			const auto field = item.find (name);
+			const auto val = field ? boost::get<T> (field) : nullptr;
+			return val ? *val : def;
+		}
+
+		// Removes a request parameter from an item that is going to be stored.
+		bool TakeFlag (Item& item, const FieldName& name)
+		{
+			if (!item.find (name))
+				return false;
+
+			const bool flag = GetParam<int64_t> (item, name);
+
+			Item stripped { item.getId (), item.getParentId (), item.getSeq () };
+			for (auto& field : item)
+				if (field.first != name)
+					stripped [field.first] = std::move (field.second);
+			item = std::move (stripped);
+			return flag;
+		}
+
+		std::vector<Operation> MakeReply (Operation&& op)
+		{
+			std::vector<Operation> result;
+			result.push_back (std::move (op));
+			return result;
+		}
+
+		// Fields are stored as keys of the item's document next to the
+		// item's own keys, so these names would clash or confuse mongo.
+		void CheckFieldName (const std::string& name, const std::string& id)
+		{
+			static const std::string reserved [] = { "id", "parentId", "seq", "_id", "_fseq" };
+
+			if (std::find (std::begin (reserved), std::end (reserved), name) != std::end (reserved) ||
+					name.find_first_of (".$") != std::string::npos)
+				throw DBOpError (ErrorCode::InvalidSemantics,
+						"invalid field name `" + name + "` in `" + id + "`");
+		}
+
+		void CheckFieldNames (const Item& item)
+		{
+			for (const auto& field : item)
+				CheckFieldName (field.first.str (), item.getId ());
+		}
+	}
+
 	DBOpError::DBOpError (ErrorCode ec, const std::string& reason)
 	: runtime_error ("DB operation error " + boost::lexical_cast<std::string> (ec) + "; " + reason)
 	, m_ec (ec)
@@ -51,31 +111,160 @@ namespace Laretz
 
 	DBOperator::DBOperator (DB_ptr db)
 	: m_db { db }
+	, m_atomic { false }
+	, m_validated { false }
 	, m_op2func {
-			{ OpType::List, [this] (const Operation& op) { return list (op); } },
-			{ OpType::Fetch, [this] (const Operation& op) { return fetch (op); } },
-			{ OpType::Append, [this] (const Operation& op) { return append (op); } },
-			{ OpType::Modify, [this] (const Operation& op) { return update (op); } }
+			{ OpType::List, [this] (Operation&& op) { return list (op); } },
+			{ OpType::Fetch, [this] (Operation&& op) { return fetch (op); } },
+			{ OpType::FetchBlob, [this] (Operation&& op) { return fetchBlob (op); } },
+			{ OpType::UploadBlob, [this] (Operation&& op) { return uploadBlob (op); } },
+			{ OpType::Subscribe, [this] (Operation&& op) { return subscribe (op); } },
+			{ OpType::Digest, [this] (Operation&& op) { return digest (op); } },
+			{ OpType::Append, [this] (Operation&& op) { return append (std::move (op)); } },
+			{ OpType::Modify, [this] (Operation&& op) { return update (std::move (op)); } },
+			{ OpType::Delete, [this] (Operation&& op) { return remove (std::move (op)); } }
 		}
 	{
 	}
 
 	std::vector<Operation> DBOperator::operator() (const std::vector<Operation>& ops)
 	{
+		return (*this) (std::vector<Operation> (ops));
+	}
+
+	std::vector<Operation> DBOperator::operator() (std::vector<Operation>&& ops)
+	{
+		if (m_atomic)
+		{
+			auto outdated = validate (ops);
+			if (!outdated.empty ())
+			{
+				m_merged.clear ();
+				return MakeReply ({ OpType::Refetch, std::move (outdated) });
+			}
+
+			m_db->beginBatch ();
+			m_validated = true;
+		}
+
 		std::vector<Operation> result;
-		for (const auto& op : ops)
+		try
+		{
+			for (auto& op : ops)
+			{
+				auto opResult = apply (std::move (op));
+				std::move (opResult.begin (), opResult.end (), std::back_inserter (result));
+			}
+		}
+		catch (...)
 		{
-			const auto& opResult = apply (op);
-			std::copy (opResult.begin (), opResult.end (), std::back_inserter (result));
+			m_validated = false;
+			m_db->endBatch ();
+			throw;
 		}
+
+		m_validated = false;
+		m_db->endBatch ();
 		return result;
 	}
 
-	std::vector<Operation> DBOperator::apply (const Operation& op)
+	void DBOperator::setAtomic (bool atomic)
+	{
+		m_atomic = atomic;
+	}
+
+	ListStream_ptr DBOperator::getListStream () const
+	{
+		return m_listStream;
+	}
+
+	const std::vector<SubscriptionRequest>& DBOperator::getSubscriptionRequests () const
+	{
+		return m_subscriptions;
+	}
+
+	// Nothing written by a batch is ever rolled back, so everything that
+	// could make it fail halfway is checked here, before the first write.
+	std::vector<Item> DBOperator::validate (std::vector<Operation>& ops)
+	{
+		std::unordered_set<std::string> appended;
+		std::unordered_set<std::string> deleted;
+		const auto isKnown = [this, &appended, &deleted] (const std::string& id)
+			{ return !deleted.count (id) && (appended.count (id) || m_db->hasItem (id)); };
+
+		// Blobs sent inline become references the batch may use later on.
+		std::unordered_set<std::string> newBlobs;
+		const auto checkBlobs = [this, &newBlobs] (const Item& item)
+		{
+			for (const auto& field : item)
+				if (const auto blob = boost::get<Blob> (&field.second))
+					newBlobs.insert (ContentHash (*blob));
+				else if (const auto ref = boost::get<BlobRef> (&field.second))
+					if (!newBlobs.count (ref->getHash ()) && !m_db->holdsBlob (ref->getHash ()))
+						throw DBOpError (ErrorCode::InvalidSemantics,
+								"unknown blob " + ref->getHash () + " in `" + item.getId () + "`");
+		};
+
+		std::vector<Item> outdated;
+		for (auto& op : ops)
+			switch (op.getType ())
+			{
+			case OpType::Append:
+				for (const auto& item : op.getItems ())
+				{
+					CheckFieldNames (item);
+					checkBlobs (item);
+
+					const auto& id = item.getId ();
+					if (appended.count (id) || deleted.count (id))
+						throw DBOpError (ErrorCode::InvalidSemantics,
+								"item `" + id + "` is appended after being appended or deleted in the same batch");
+
+					const auto& parentId = item.getParentId ();
+					if (!parentId.empty () && !isKnown (parentId))
+						throw DBOpError (ErrorCode::UnknownParent, "unknown parent for `" + parentId + "`");
+					appended.insert (id);
+				}
+				break;
+			case OpType::Modify:
+				for (auto& item : op.getItems ())
+				{
+					CheckFieldNames (item);
+					checkBlobs (item);
+
+					// Items appended in the same batch have no seq to check yet.
+					if (!isKnown (item.getId ()))
+						throw DBOpError (ErrorCode::InvalidSemantics, "unknown item `" + item.getId () + "`");
+					else if (appended.count (item.getId ()))
+						TakeFlag (item, "autoMerge");
+					else if (const auto dbSeq = checkItem (item))
+						outdated.push_back ({ item.getId (), dbSeq });
+				}
+				break;
+			case OpType::Delete:
+				for (const auto& item : op.getItems ())
+				{
+					if (!isKnown (item.getId ()))
+						throw DBOpError (ErrorCode::InvalidSemantics, "unknown item `" + item.getId () + "`");
+					deleted.insert (item.getId ());
+				}
+				break;
+			case OpType::UploadBlob:
+			case OpType::Subscribe:
+				throw DBOpError (ErrorCode::InvalidSemantics,
+						"blob uploads and subscriptions cannot be a part of an atomic batch");
+			default:
+				break;
+			}
+
+		return outdated;
+	}
+
+	std::vector<Operation> DBOperator::apply (Operation&& op)
 	{
 		const auto pos = m_op2func.find (op.getType ());
 		if (pos != m_op2func.end ())
-			return pos->second (op);
+			return pos->second (std::move (op));
 		else
 			return {};
 	}
@@ -87,13 +276,38 @@ namespace Laretz
 					"at least one item should be present for the list operation");
 
 		const auto& reqItem = op.getItems ().front ();
+		const auto limit = GetParam<int64_t> (reqItem, "limit");
+		if (limit < 0)
+			throw DBOpError (ErrorCode::InvalidSemantics, "list limit should be non-negative");
+
+		const auto& roots = SelectListRoots (op.getItems ());
+
+		uint64_t minSeq = reqItem.getSeq ();
+		for (const auto& root : roots)
+			minSeq = std::min (minSeq, root.m_after);
+
 		try
 		{
-			return
+			ListBodyOptions bodyOptions;
+			bodyOptions.m_enabled = GetParam<int64_t> (reqItem, "bodies");
+			bodyOptions.m_fields = GetParam<std::vector<std::string>> (reqItem, "fields");
+
+			// Only the last List of a packet is continued, the ones before
+			// it are sent in full.
+			std::vector<Operation> result;
+			while (m_listStream && !m_listStream->atEnd ())
 			{
-				{ OpType::List, m_db->enumerateItems (reqItem.getSeq (), reqItem.getParentId ()) },
-				{ OpType::Delete, m_db->enumerateRemoved (reqItem.getSeq ()) },
-			};
+				auto chunk = m_listStream->nextOps ();
+				std::move (chunk.begin (), chunk.end (), std::back_inserter (result));
+			}
+
+			m_listStream = std::make_shared<ListStream> (std::make_shared<DBListSource> (m_db, bodyOptions),
+					roots, minSeq, GetParam<std::string> (reqItem, "cursor"), limit, bodyOptions);
+			m_listStream->setCompact (GetParam<int64_t> (reqItem, "compact"));
+
+			auto chunk = m_listStream->nextOps ();
+			std::move (chunk.begin (), chunk.end (), std::back_inserter (result));
+			return result;
 		}
 		catch (const UnknownParentError& e)
 		{
@@ -103,48 +317,305 @@ namespace Laretz
 
 	std::vector<Operation> DBOperator::fetch (const Operation& op)
 	{
-		Operation res { OpType::Fetch, {} };
+		Operation res { OpType::Fetch, std::vector<Item> () };
+		res.getItems ().reserve (op.getItems ().size ());
+		for (const auto& item : op.getItems ())
+		{
+			const bool blobRefs = GetParam<std::string> (item, "blobs") == "ref";
+			if (auto optItem = m_db->loadItem (item.getId (), blobRefs))
+			{
+				if (blobRefs)
+					ReplaceBlobsWithRefs (*optItem);
+				res += std::move (*optItem);
+			}
+		}
+
+		return MakeReply (std::move (res));
+	}
+
+	std::vector<Operation> DBOperator::fetchBlob (const Operation& op)
+	{
+		std::vector<Item> outdated;
+		Operation res { OpType::FetchBlob, std::vector<Item> () };
+		for (const auto& item : op.getItems ())
+		{
+			const auto& fieldName = GetParam<std::string> (item, "field");
+			const auto offset = GetParam<int64_t> (item, "offset");
+			auto length = GetParam<int64_t> (item, "length");
+			if (fieldName.empty () || offset < 0 || length < 0)
+				throw DBOpError (ErrorCode::InvalidSemantics,
+						"blob range request should have a field name and a non-negative range");
+
+			const auto& stored = m_db->loadItem (item.getId (), true);
+			if (!stored)
+				continue;
+
+			if (item.getSeq () && stored->getSeq () > item.getSeq ())
+			{
+				outdated.push_back ({ item.getId (), stored->getSeq () });
+				continue;
+			}
+
+			const auto field = stored->find (fieldName);
+			const auto blob = field ? boost::get<Blob> (field) : nullptr;
+			const auto ref = field ? boost::get<BlobRef> (field) : nullptr;
+			if (!blob && !ref)
+				throw DBOpError (ErrorCode::InvalidSemantics,
+						"field `" + fieldName + "` of `" + item.getId () + "` is not a blob");
+
+			const auto size = static_cast<int64_t> (blob ? blob->size () : ref->size ());
+			const auto begin = std::min (offset, size);
+			if (!length || length > MaxBlobRange)
+				length = MaxBlobRange;
+			length = std::min (length, size - begin);
+
+			Item chunk { stored->getId (), stored->getParentId (), stored->getSeq () };
+			chunk ["field"] = fieldName;
+			chunk ["offset"] = begin;
+			chunk ["size"] = size;
+			if (blob)
+				chunk ["data"] = Blob (std::make_shared<Blob> (*blob), blob->data () + begin, length);
+			else
+				chunk ["data"] = m_db->loadBlob (ref->getHash (), begin, length);
+			res += std::move (chunk);
+		}
+
+		if (!outdated.empty ())
+			return MakeReply ({ OpType::Refetch, std::move (outdated) });
+
+		return MakeReply (std::move (res));
+	}
+
+	std::vector<Operation> DBOperator::uploadBlob (const Operation& op)
+	{
+		std::vector<Item> outdated;
+		Operation res { OpType::UploadBlob, std::vector<Item> () };
 		for (const auto& item : op.getItems ())
-			if (const auto optItem = m_db->loadItem (item.getId ()))
-				res += *optItem;
+		{
+			const auto& upload = GetParam<std::string> (item, "uploadId");
+			const auto& fieldName = GetParam<std::string> (item, "uploadField");
+			const auto offset = GetParam<int64_t> (item, "uploadOffset");
+			const auto& data = GetParam<Blob> (item, "uploadData");
+			const bool isFinal = GetParam<int64_t> (item, "uploadFinal");
+			if (upload.empty () || fieldName.empty () || offset < 0)
+				throw DBOpError (ErrorCode::InvalidSemantics,
+						"blob upload should have an upload id, a field name and a non-negative offset");
+
+			CheckFieldNames (item);
+			CheckFieldName (fieldName, item.getId ());
+
+			const auto staged = m_db->stageBlobChunk (item.getId (), upload, offset, data);
+
+			Item reply { item.getId (), item.getParentId (), 0 };
+			reply ["uploadId"] = upload;
+			reply ["uploadOffset"] = static_cast<int64_t> (staged);
+
+			// A retry of the final chunk whose reply has been lost.
+			if (const auto committed = m_db->getCommittedUpload (item.getId (), upload))
+			{
+				reply.setSeq (*committed);
+				reply ["uploadFinal"] = static_cast<int64_t> (1);
+				res += std::move (reply);
+				continue;
+			}
+
+			if (isFinal && staged == offset + data.size ())
+			{
+				if (m_db->hasItem (item.getId ()))
+				{
+					const auto dbSeq = m_db->getSeqNum (item.getId ());
+					if (dbSeq > item.getSeq ())
+					{
+						outdated.push_back ({ item.getId (), dbSeq });
+						continue;
+					}
+				}
+
+				static const FieldName uploadFields [] =
+						{ "uploadId", "uploadField", "uploadOffset", "uploadData", "uploadFinal" };
+
+				Item commit { item.getId (), item.getParentId (), item.getSeq () };
+				for (const auto& field : item)
+					if (field.first != fieldName &&
+							std::find (std::begin (uploadFields), std::end (uploadFields), field.first) == std::end (uploadFields))
+						commit [field.first] = field.second;
 
-		return { res };
+				reply.setSeq (m_db->commitUpload (commit, fieldName, upload));
+				reply ["uploadFinal"] = static_cast<int64_t> (1);
+			}
+
+			res += std::move (reply);
+		}
+
+		auto result = MakeReply (std::move (res));
+		if (!outdated.empty ())
+			result.emplace_back (OpType::Refetch, std::move (outdated));
+		return result;
 	}
 
-	std::vector<Operation> DBOperator::append (const Operation& op)
+	std::vector<Operation> DBOperator::subscribe (const Operation& op)
 	{
-		return doWithCheck (op, false, [] (DB_ptr db, Item item) { return db->addItem (item); });
+		const auto seq = m_db->getSeqNum ();
+
+		std::vector<Item> replies;
+		for (const auto& item : op.getItems ())
+		{
+			const auto& parentId = item.getParentId ();
+			if (!parentId.empty () && !m_db->hasItem (parentId))
+				throw DBOpError (ErrorCode::UnknownParent, "unknown parent for `" + parentId + "`");
+
+			m_subscriptions.push_back ({ parentId,
+					static_cast<bool> (GetParam<int64_t> (item, "subtree")),
+					static_cast<bool> (GetParam<int64_t> (item, "cancel")) });
+			replies.push_back ({ {}, parentId, seq });
+		}
+
+		return MakeReply ({ OpType::Subscribe, std::move (replies) });
 	}
 
-	std::vector<Operation> DBOperator::update (const Operation& op)
+	std::vector<Operation> DBOperator::digest (const Operation& op)
 	{
-		return doWithCheck (op, true, [] (DB_ptr db, Item item) { return db->modifyItem (item); });
+		const auto setDigest = [] (Item& item, const SubtreeDigest& digest)
+		{
+			item ["digest"] = static_cast<int64_t> (digest.m_digest);
+			item ["count"] = static_cast<int64_t> (digest.m_count);
+		};
+
+		// Every requested parent gets its own Digest op: the first item
+		// describes the parent's subtree, and the rest describe the subtrees
+		// of its children unless the client's digest already matches.
+		std::vector<Operation> result;
+		for (const auto& item : op.getItems ())
+		{
+			const auto& parentId = item.getParentId ();
+			if (!parentId.empty () && !m_db->hasItem (parentId))
+				throw DBOpError (ErrorCode::UnknownParent, "unknown parent for `" + parentId + "`");
+
+			const auto& digest = m_db->getDigest (parentId);
+
+			std::vector<Item> replies;
+			replies.push_back ({ parentId, {},
+					parentId.empty () ? m_db->getSeqNum () : m_db->getSeqNum (parentId) });
+			setDigest (replies.back (), digest);
+
+			const SubtreeDigest known
+			{
+				static_cast<uint64_t> (GetParam<int64_t> (item, "digest", -1)),
+				static_cast<uint64_t> (GetParam<int64_t> (item, "count", -1))
+			};
+			if (known != digest)
+			{
+				const auto& children = m_db->listChildren (parentId);
+
+				std::vector<std::string> childIds;
+				for (const auto& child : children)
+					childIds.push_back (child.getId ());
+				const auto& childDigests = m_db->getDigests (childIds);
+
+				for (auto child : children)
+				{
+					const auto pos = childDigests.find (child.getId ());
+					setDigest (child, pos != childDigests.end () ? pos->second : SubtreeDigest ());
+					replies.push_back (std::move (child));
+				}
+			}
+
+			result.emplace_back (OpType::Digest, std::move (replies));
+		}
+
+		return result;
 	}
 
-	std::vector<Operation> DBOperator::remove (const Operation& op)
+	std::vector<Operation> DBOperator::append (Operation&& op)
 	{
-		return doWithCheck (op, false, [] (DB_ptr db, Item item) { return db->removeItem (item.getId ()); });
+		return doWithCheck (std::move (op), false,
+				[] (DB_ptr db, const Item& item) { return db->addItem (item); });
 	}
 
-	std::vector<Operation> DBOperator::doWithCheck (const Operation& op,
-			bool check, std::function<uint64_t (DB_ptr, Item)> modifier)
+	std::vector<Operation> DBOperator::update (Operation&& op)
 	{
-		auto items = op.getItems ();
+		return doWithCheck (std::move (op), true,
+				[] (DB_ptr db, const Item& item) { return db->modifyItem (item); });
+	}
 
+	std::vector<Operation> DBOperator::remove (Operation&& op)
+	{
+		return doWithCheck (std::move (op), false,
+				[] (DB_ptr db, const Item& item) { return db->removeItem (item.getId ()); });
+	}
+
+	std::vector<Operation> DBOperator::doWithCheck (Operation&& op,
+			bool check, std::function<uint64_t (DB_ptr, const Item&)> modifier)
+	{
+		auto& items = op.getItems ();
+		for (const auto& item : items)
+			CheckFieldNames (item);
+
+		// An atomic batch has been checked as a whole already.
 		std::vector<Item> outdated;
-		if (check)
-			for (const auto& item : items)
-			{
-				const auto dbSeq = m_db->getSeqNum (item.getId ());
-				if (dbSeq > item.getSeq ())
+		if (check && !m_validated)
+			for (auto& item : items)
+				if (const auto dbSeq = checkItem (item))
 					outdated.push_back ({ item.getId (), dbSeq });
-			}
 
 		if (!outdated.empty ())
-			return { { OpType::Refetch, outdated } };
+		{
+			m_merged.clear ();
+			return MakeReply ({ OpType::Refetch, std::move (outdated) });
+		}
 
 		for (auto& item : items)
+		{
 			item.setSeq (modifier (m_db, item));
-		return { { op.getType (), items } };
+
+			const auto pos = m_merged.find (item.getId ());
+			if (pos == m_merged.end ())
+				continue;
+
+			const auto changed = std::move (pos->second);
+			m_merged.erase (pos);
+			if (changed.empty ())
+				continue;
+
+			const auto& current = m_db->loadItem (item.getId (), true);
+			if (!current)
+				continue;
+
+			for (const auto& name : changed)
+				if (const auto field = current->find (name))
+					item [name] = *field;
+		}
+		return MakeReply (std::move (op));
+	}
+
+	uint64_t DBOperator::checkItem (Item& item)
+	{
+		const bool autoMerge = TakeFlag (item, "autoMerge");
+
+		const auto dbSeq = m_db->getSeqNum (item.getId ());
+		if (dbSeq <= item.getSeq ())
+			return 0;
+
+		// With autoMerge an outdated item is still written if none of its
+		// fields have been changed since the client's seq. The reply then
+		// carries the fields the client has missed.
+		const auto& changed = autoMerge ?
+				m_db->getChangedFields (item.getId (), item.getSeq ()) :
+				boost::none;
+		const auto overlaps = [&item, &changed]
+		{
+			return std::any_of (changed->begin (), changed->end (),
+					[&item] (const std::string& name)
+					{
+						const auto field = item.find (name);
+						return field && !boost::get<BlobRef> (field);
+					});
+		};
+
+		if (!changed || overlaps ())
+			return dbSeq;
+
+		m_merged [item.getId ()] = *changed;
+		return 0;
 	}
 }
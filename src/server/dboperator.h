@@ -30,6 +30,8 @@
 
 #include <memory>
 #include <vector>
+#include <map>
+#include <unordered_map>
 #include <functional>
 #include <stdexcept>
 #include "operation.h"
@@ -39,6 +41,9 @@ namespace Laretz
 	class DB;
 	typedef std::shared_ptr<DB> DB_ptr;
 
+	class ListStream;
+	typedef std::shared_ptr<ListStream> ListStream_ptr;
+
 	class DBOpError : public std::runtime_error
 	{
 	public:
@@ -52,25 +57,52 @@ namespace Laretz
 		ErrorCode getEC () const;
 	};
 
+	struct SubscriptionRequest
+	{
+		std::string m_parentId;
+		bool m_subtree;
+		bool m_cancel;
+	};
+
 	class DBOperator
 	{
 		DB_ptr m_db;
+		ListStream_ptr m_listStream;
+		std::vector<SubscriptionRequest> m_subscriptions;
 
-		const std::map<OpType, std::function<std::vector<Operation> (Operation)>> m_op2func;
+		bool m_atomic;
+		bool m_validated;
+		std::unordered_map<std::string, std::vector<std::string>> m_merged;
+
+		const std::map<OpType, std::function<std::vector<Operation> (Operation&&)>> m_op2func;
 	public:
 		DBOperator (DB_ptr);
 
 		std::vector<Operation> operator() (const std::vector<Operation>&);
+		std::vector<Operation> operator() (std::vector<Operation>&&);
+
+		// Validates all the write operations before applying any of them
+		// and gives everything they write a single seq.
+		void setAtomic (bool);
+
+		ListStream_ptr getListStream () const;
+		const std::vector<SubscriptionRequest>& getSubscriptionRequests () const;
 	private:
-		std::vector<Operation> apply (const Operation&);
+		std::vector<Item> validate (std::vector<Operation>&);
+		std::vector<Operation> apply (Operation&&);
 
 		std::vector<Operation> list (const Operation&);
 		std::vector<Operation> fetch (const Operation&);
-		std::vector<Operation> append (const Operation&);
-		std::vector<Operation> update (const Operation&);
-		std::vector<Operation> remove (const Operation&);
+		std::vector<Operation> fetchBlob (const Operation&);
+		std::vector<Operation> uploadBlob (const Operation&);
+		std::vector<Operation> subscribe (const Operation&);
+		std::vector<Operation> digest (const Operation&);
+		std::vector<Operation> append (Operation&&);
+		std::vector<Operation> update (Operation&&);
+		std::vector<Operation> remove (Operation&&);
 
-		std::vector<Operation> doWithCheck (const Operation&,
-				bool checkParent, std::function<uint64_t (DB_ptr, Item)> modifier);
+		std::vector<Operation> doWithCheck (Operation&&,
+				bool checkParent, std::function<uint64_t (DB_ptr, const Item&)> modifier);
+		uint64_t checkItem (Item&);
 	};
 }
@@ -36,7 +36,7 @@ namespace Laretz
 		struct ToBSONVisitor : boost::static_visitor<void>
 		{
 			mongo::BSONObjBuilder &m_builder;
-			const std::string m_name;
+			const std::string& m_name;
 
 			ToBSONVisitor (mongo::BSONObjBuilder& builder, const std::string& name)
 			: m_builder (builder)
@@ -44,9 +44,14 @@ namespace Laretz
 			{
 			}
 
-			void operator() (const std::vector<char>& str) const
+			void operator() (const Blob& blob) const
+			{
+				m_builder.appendBinData (m_name, blob.size (), mongo::BinDataGeneral, blob.data ());
+			}
+
+			// A reference carries no contents, so the stored blob is left as is.
+			void operator() (const BlobRef&) const
 			{
-				m_builder.append (m_name, str.data (), str.size ());
 			}
 
 			void operator() (int64_t num) const
@@ -62,18 +67,31 @@ namespace Laretz
 		};
 	}
 
-	mongo::BSONObj toBSON (const Item& item, bool withSeq)
+	namespace
 	{
-		mongo::BSONObjBuilder builder;
-		builder << "id" << item.getId ();
-		builder << "parentId" << item.getParentId ();
+		mongo::BSONObj ToBSON (const Item& item, const uint64_t *seq)
+		{
+			mongo::BSONObjBuilder builder;
+			builder << "id" << item.getId ();
+			builder << "parentId" << item.getParentId ();
 
-		if (withSeq)
-			builder << "seq" << static_cast<long long> (item.getSeq ());
+			if (seq)
+				builder << "seq" << static_cast<long long> (*seq);
 
-		for (const auto& pair : item)
-			boost::apply_visitor (ToBSONVisitor (builder, pair.first), pair.second);
+			for (const auto& pair : item)
+				boost::apply_visitor (ToBSONVisitor (builder, pair.first), pair.second);
 
-		return builder.obj ();
+			return builder.obj ();
+		}
+	}
+
+	mongo::BSONObj toBSON (const Item& item)
+	{
+		return ToBSON (item, nullptr);
+	}
+
+	mongo::BSONObj toBSON (const Item& item, uint64_t seq)
+	{
+		return ToBSON (item, &seq);
 	}
 }
@@ -38,5 +38,6 @@ namespace mongo
 
 namespace Laretz
 {
-	mongo::BSONObj toBSON (const Item&, bool withSeq = false);
+	mongo::BSONObj toBSON (const Item&);
+	mongo::BSONObj toBSON (const Item&, uint64_t seq);
 }
@@ -0,0 +1,71 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#include "listroots.h"
+#include <algorithm>
+#include "item.h"
+
+namespace Laretz
+{
+	std::vector<ListRoot> SelectListRoots (const std::vector<Item>& items)
+	{
+		std::vector<ListRoot> roots;
+		std::unordered_map<std::string, size_t> byParent;
+		for (size_t i = 0; i < items.size (); ++i)
+		{
+			const auto& item = items [i];
+			const auto pos = byParent.find (item.getParentId ());
+			if (pos == byParent.end ())
+			{
+				byParent [item.getParentId ()] = roots.size ();
+				roots.push_back ({ item.getParentId (), item.getSeq (), i });
+			}
+			else if (item.getSeq () < roots [pos->second].m_after)
+				roots [pos->second] = { item.getParentId (), item.getSeq (), i };
+		}
+		return roots;
+	}
+
+	NestedRoots::NestedRoots (const std::vector<ListRoot>& roots)
+	{
+		for (const auto& root : roots)
+		{
+			const auto pos = m_afters.find (root.m_parentId);
+			if (pos == m_afters.end ())
+				m_afters [root.m_parentId] = root.m_after;
+			else
+				pos->second = std::min (pos->second, root.m_after);
+		}
+	}
+
+	bool NestedRoots::isCovered (const std::string& id, uint64_t after) const
+	{
+		const auto pos = m_afters.find (id);
+		return pos != m_afters.end () && pos->second <= after;
+	}
+}
@@ -0,0 +1,67 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+namespace Laretz
+{
+	class Item;
+
+	struct ListRoot
+	{
+		std::string m_parentId;
+		uint64_t m_after;
+
+		// Position of the root's item in the List request.
+		size_t m_index;
+	};
+
+	// Roots of a List request. Only the roots of the same parent are
+	// merged, into the one listing from the oldest seq: a parent's seq
+	// follows its direct children only, so a root can't tell from the seqs
+	// whether it covers a deeper one.
+	std::vector<ListRoot> SelectListRoots (const std::vector<Item>&);
+
+	// Decides where the walk of one root stops because another root lists
+	// that subtree anyway.
+	class NestedRoots
+	{
+		std::unordered_map<std::string, uint64_t> m_afters;
+	public:
+		NestedRoots (const std::vector<ListRoot>&);
+
+		// A subtree is skipped only if another root lists it from an older
+		// or the same seq as the walk's own.
+		bool isCovered (const std::string& id, uint64_t after) const;
+	};
+}
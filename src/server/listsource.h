@@ -0,0 +1,69 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <cstdint>
+
+namespace Laretz
+{
+	class Item;
+
+	// Where a ListStream takes the items from. Cursors return items in
+	// (seq, id) order, starting right after the (lastSeq, lastId) position
+	// unless lastId is empty.
+	class ListSource
+	{
+	public:
+		class Cursor
+		{
+		public:
+			virtual ~Cursor () {}
+
+			virtual bool more () = 0;
+			// The id and seq of the item, and its body if the source was
+			// asked for them.
+			virtual Item next () = 0;
+		};
+		typedef std::unique_ptr<Cursor> Cursor_ptr;
+
+		virtual ~ListSource () {}
+
+		virtual bool hasItem (const std::string& id) const = 0;
+
+		virtual Cursor_ptr queryChildren (const std::string& parentId, uint64_t after,
+				uint64_t lastSeq, const std::string& lastId) const = 0;
+		// Items removed after the given seq.
+		virtual Cursor_ptr queryRemoved (uint64_t after,
+				uint64_t lastSeq, const std::string& lastId) const = 0;
+	};
+
+	typedef std::shared_ptr<ListSource> ListSource_ptr;
+}
@@ -0,0 +1,339 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#include "liststream.h"
+#include <sstream>
+#include <iterator>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/algorithm/hex.hpp>
+#include <boost/lexical_cast.hpp>
+#include "dberror.h"
+#include "operation.h"
+#include "compactlist.h"
+
+namespace Laretz
+{
+	namespace
+	{
+		// Starts the cursors of the removed items, which aren't bound to
+		// any of the roots.
+		const char RemovedMark = '~';
+
+		template<typename Level>
+		void ParsePosition (const std::string& str, Level& level)
+		{
+			const auto dashPos = str.find ('-');
+			if (dashPos == std::string::npos)
+				throw DBError ("malformed list cursor");
+
+			level.m_lastSeq = boost::lexical_cast<uint64_t> (str.substr (0, dashPos));
+			boost::algorithm::unhex (str.begin () + dashPos + 1, str.end (), std::back_inserter (level.m_lastId));
+		}
+
+		template<typename Level>
+		void FormatPosition (std::ostream& ostr, const Level& level)
+		{
+			if (level.m_lastId.empty ())
+				return;
+
+			ostr << level.m_lastSeq << '-';
+			boost::algorithm::hex (level.m_lastId, std::ostream_iterator<char> (ostr));
+		}
+	}
+
+	ListStream::ListStream (ListSource_ptr source, const std::vector<Root>& roots, uint64_t removedAfter,
+			const std::string& cursor, size_t limit, const ListBodyOptions& bodyOptions)
+	: m_source (source)
+	, m_roots (roots)
+	, m_nestedRoots (roots)
+	, m_currentRoot (0)
+	, m_limit (limit)
+	, m_emitted (0)
+	, m_removedAfter (removedAfter)
+	, m_removed { {}, 0, {}, {} }
+	, m_inRemoved (roots.empty ())
+	, m_bodyOptions (bodyOptions)
+	, m_compact (false)
+	{
+		for (const auto& root : m_roots)
+			if (!root.m_parentId.empty () && !m_source->hasItem (root.m_parentId))
+				throw UnknownParentError ("unknown parent for `" + root.m_parentId + "`");
+
+		if (!cursor.empty () && cursor [0] == RemovedMark)
+		{
+			m_inRemoved = true;
+			m_currentRoot = m_roots.empty () ? 0 : m_roots.size () - 1;
+			if (cursor.size () > 1)
+				ParsePosition (cursor.substr (1), m_removed);
+		}
+		else if (m_roots.size () > 1 && !cursor.empty ())
+		{
+			const auto colonPos = cursor.find (':');
+			if (colonPos == std::string::npos)
+				throw DBError ("malformed list cursor");
+
+			m_currentRoot = boost::lexical_cast<size_t> (cursor.substr (0, colonPos));
+			if (m_currentRoot >= m_roots.size ())
+				throw DBError ("malformed list cursor");
+
+			m_levels.push_back ({ m_roots [m_currentRoot].m_parentId, 0, {}, {} });
+			parseCursor (cursor.substr (colonPos + 1));
+		}
+		else if (!m_roots.empty ())
+		{
+			m_levels.push_back ({ m_roots.front ().m_parentId, 0, {}, {} });
+			parseCursor (cursor);
+		}
+	}
+
+	void ListStream::parseCursor (const std::string& cursor)
+	{
+		if (cursor.empty ())
+			return;
+
+		std::vector<std::string> levels;
+		boost::split (levels, cursor, boost::is_any_of ("."));
+		for (size_t i = 0; i < levels.size (); ++i)
+		{
+			const auto& level = levels [i];
+			if (level.empty ())
+			{
+				if (i != levels.size () - 1)
+					throw DBError ("malformed list cursor");
+				break;
+			}
+
+			auto& last = m_levels.back ();
+			ParsePosition (level, last);
+
+			if (i != levels.size () - 1)
+				m_levels.push_back ({ last.m_lastId, 0, {}, {} });
+		}
+	}
+
+	std::vector<Item> ListStream::next (size_t maxItems)
+	{
+		if (m_limit)
+			maxItems = std::min (maxItems, m_limit - m_emitted);
+
+		std::vector<Item> result;
+		while (result.size () < maxItems)
+		{
+			if (m_levels.empty ())
+			{
+				if (!result.empty () || !advanceRoot ())
+					break;
+				continue;
+			}
+
+			auto& level = m_levels.back ();
+			auto& cursor = openCursor (level);
+			if (!cursor.more ())
+			{
+				m_levels.pop_back ();
+				continue;
+			}
+
+			auto item = cursor.next ();
+			const auto id = item.getId ();
+			result.push_back ({ id, item.getSeq () });
+			if (m_compact)
+				result.back ().setParentId (level.m_parentId);
+			if (m_bodyOptions.m_enabled)
+				m_bodies.push_back (std::move (item));
+
+			level.m_lastSeq = result.back ().getSeq ();
+			level.m_lastId = id;
+
+			if (!m_nestedRoots.isCovered (id, m_roots [m_currentRoot].m_after))
+				m_levels.push_back ({ id, 0, {}, {} });
+		}
+
+		m_emitted += result.size ();
+		return result;
+	}
+
+	std::vector<Operation> ListStream::nextOps (size_t maxItems)
+	{
+		m_chunkRoots.clear ();
+		m_bodies.clear ();
+
+		std::vector<Operation> result;
+		bool listed = false;
+		size_t count = 0;
+		while (count < maxItems && !atEnd ())
+		{
+			if (m_inRemoved)
+			{
+				auto removed = nextRemoved (maxItems - count);
+				count += removed.size ();
+				result.emplace_back (OpType::Delete, std::move (removed));
+				continue;
+			}
+
+			const auto root = m_roots [m_currentRoot].m_index;
+			auto items = next (maxItems - count);
+			if (items.empty ())
+				continue;
+
+			count += items.size ();
+			if (m_compact)
+				result.push_back (MakeCompactList (items));
+			else
+				result.emplace_back (OpType::List, std::move (items));
+			m_chunkRoots.push_back (root);
+			listed = true;
+		}
+
+		// Clients look for a List in every reply to a List, even in the
+		// chunks that only carry the removed items.
+		if (!listed)
+		{
+			result.insert (result.begin (), Operation (OpType::List, std::vector<Item> ()));
+			m_chunkRoots.push_back (m_roots.empty () ? 0 : m_roots [m_currentRoot].m_index);
+		}
+
+		// Projected bodies are partial, so they are sent as a Modify to be
+		// merged into what the client has, and full ones as a Fetch.
+		if (m_bodyOptions.m_enabled)
+			result.emplace_back (m_bodyOptions.m_fields.empty () ? OpType::Fetch : OpType::Modify,
+					std::move (m_bodies));
+		m_bodies.clear ();
+
+		return result;
+	}
+
+	void ListStream::setCompact (bool compact)
+	{
+		m_compact = compact;
+	}
+
+	bool ListStream::atEnd ()
+	{
+		return (m_limit && m_emitted >= m_limit) || isComplete ();
+	}
+
+	bool ListStream::isComplete ()
+	{
+		while (!m_inRemoved)
+		{
+			while (!m_levels.empty ())
+			{
+				if (openCursor (m_levels.back ()).more ())
+					return false;
+
+				m_levels.pop_back ();
+			}
+
+			advanceRoot ();
+		}
+
+		return !openRemoved ().more ();
+	}
+
+	std::string ListStream::getCursor () const
+	{
+		std::ostringstream ostr;
+		if (m_inRemoved)
+		{
+			ostr << RemovedMark;
+			FormatPosition (ostr, m_removed);
+			return ostr.str ();
+		}
+
+		if (m_roots.size () > 1)
+			ostr << m_currentRoot << ':';
+
+		for (size_t i = 0; i < m_levels.size (); ++i)
+		{
+			if (i)
+				ostr << '.';
+			FormatPosition (ostr, m_levels [i]);
+		}
+		return ostr.str ();
+	}
+
+	bool ListStream::hasIndexedRoots () const
+	{
+		return m_roots.size () > 1 || (m_roots.size () == 1 && m_roots.front ().m_index);
+	}
+
+	std::string ListStream::getChunkRoots () const
+	{
+		std::ostringstream ostr;
+		for (size_t i = 0; i < m_chunkRoots.size (); ++i)
+			ostr << (i ? "," : "") << m_chunkRoots [i];
+		return ostr.str ();
+	}
+
+	std::vector<Item> ListStream::nextRemoved (size_t maxItems)
+	{
+		std::vector<Item> result;
+		auto& cursor = openRemoved ();
+		while (result.size () < maxItems && cursor.more ())
+		{
+			result.push_back (cursor.next ());
+			m_removed.m_lastSeq = result.back ().getSeq ();
+			m_removed.m_lastId = result.back ().getId ();
+		}
+		return result;
+	}
+
+	bool ListStream::advanceRoot ()
+	{
+		if (m_inRemoved)
+			return false;
+
+		if (m_currentRoot + 1 >= m_roots.size ())
+		{
+			m_inRemoved = true;
+			return false;
+		}
+
+		++m_currentRoot;
+		m_levels.push_back ({ m_roots [m_currentRoot].m_parentId, 0, {}, {} });
+		return true;
+	}
+
+	ListSource::Cursor& ListStream::openCursor (Level& level)
+	{
+		if (!level.m_cursor)
+			level.m_cursor = m_source->queryChildren (level.m_parentId,
+					m_roots [m_currentRoot].m_after, level.m_lastSeq, level.m_lastId);
+		return *level.m_cursor;
+	}
+
+	ListSource::Cursor& ListStream::openRemoved ()
+	{
+		if (!m_removed.m_cursor)
+			m_removed.m_cursor = m_source->queryRemoved (m_removedAfter, m_removed.m_lastSeq, m_removed.m_lastId);
+		return *m_removed.m_cursor;
+	}
+}
@@ -0,0 +1,117 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "item.h"
+#include "listroots.h"
+#include "listsource.h"
+
+namespace Laretz
+{
+	class Operation;
+
+	// Makes a ListStream return the bodies of the listed items along with
+	// their ids, limited to m_fields unless that is empty. Blobs always go
+	// as references, so a chunk of bodies stays as small as its items are.
+	struct ListBodyOptions
+	{
+		bool m_enabled = false;
+		std::vector<std::string> m_fields;
+	};
+
+	// Walks the roots of a List request depth first, and then the items
+	// removed since, in chunks that can be resumed from a cursor.
+	class ListStream
+	{
+	public:
+		typedef ListRoot Root;
+
+	private:
+		const ListSource_ptr m_source;
+		std::vector<Root> m_roots;
+		const NestedRoots m_nestedRoots;
+		size_t m_currentRoot;
+
+		const size_t m_limit;
+		size_t m_emitted;
+
+		struct Level
+		{
+			std::string m_parentId;
+
+			uint64_t m_lastSeq;
+			std::string m_lastId;
+
+			std::shared_ptr<ListSource::Cursor> m_cursor;
+		};
+		std::vector<Level> m_levels;
+
+		const uint64_t m_removedAfter;
+		Level m_removed;
+		bool m_inRemoved;
+
+		const ListBodyOptions m_bodyOptions;
+		std::vector<Item> m_bodies;
+
+		std::vector<size_t> m_chunkRoots;
+
+		bool m_compact;
+	public:
+		enum { DefaultChunkSize = 1000 };
+
+		ListStream (ListSource_ptr, const std::vector<Root>& roots, uint64_t removedAfter,
+				const std::string& cursor = std::string (), size_t limit = 0,
+				const ListBodyOptions& = ListBodyOptions ());
+
+		std::vector<Item> next (size_t maxItems = DefaultChunkSize);
+		std::vector<Operation> nextOps (size_t maxItems = DefaultChunkSize);
+
+		// Makes nextOps() pack the listed items into the compact List form.
+		void setCompact (bool);
+
+		bool atEnd ();
+		bool isComplete ();
+
+		std::string getCursor () const;
+		bool hasIndexedRoots () const;
+		std::string getChunkRoots () const;
+	private:
+		void parseCursor (const std::string&);
+		std::vector<Item> nextRemoved (size_t maxItems);
+		bool advanceRoot ();
+		ListSource::Cursor& openCursor (Level&);
+		ListSource::Cursor& openRemoved ();
+	};
+
+	typedef std::shared_ptr<ListStream> ListStream_ptr;
+}
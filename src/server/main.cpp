@@ -26,11 +26,49 @@
  * DEALINGS IN THE SOFTWARE.
  **********************************************************************/
 
+
+#include <iostream>
+#include <boost/program_options.hpp>
 #include "server.h"
 
-int main(int argc, char **argv)
+int main (int argc, char **argv)
 {
-	Laretz::Server s;
+	namespace po = boost::program_options;
+
+	Laretz::ServerLimits limits;
+
+	po::options_description desc ("Allowed options");
+	desc.add_options ()
+		("help", "show this help message")
+		("max-packet-size",
+			po::value<size_t> (&limits.m_maxPacketSize)->default_value (limits.m_maxPacketSize),
+			"maximum size of a single request packet, in bytes")
+		("max-connection-buffer",
+			po::value<size_t> (&limits.m_maxConnectionBuffer)->default_value (limits.m_maxConnectionBuffer),
+			"amount of unsent reply data after which a connection stops reading requests, in bytes")
+		("max-total-memory",
+			po::value<size_t> (&limits.m_maxTotalMemory)->default_value (limits.m_maxTotalMemory),
+			"amount of buffered request and reply data for all connections, in bytes");
+
+	po::variables_map vm;
+	try
+	{
+		po::store (po::parse_command_line (argc, argv, desc), vm);
+		po::notify (vm);
+	}
+	catch (const po::error& e)
+	{
+		std::cerr << e.what () << std::endl << desc << std::endl;
+		return 1;
+	}
+
+	if (vm.count ("help"))
+	{
+		std::cout << desc << std::endl;
+		return 0;
+	}
+
+	Laretz::Server s { limits };
 	s.run ();
 	return 0;
 }
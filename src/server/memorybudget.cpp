@@ -0,0 +1,66 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+
+#include "memorybudget.h"
+
+namespace Laretz
+{
+	MemoryBudget::MemoryBudget (size_t limit)
+	: m_limit (limit)
+	, m_used (0)
+	{
+	}
+
+	bool MemoryBudget::tryAcquire (size_t size)
+	{
+		auto used = m_used.load ();
+		do
+		{
+			if (used + size > m_limit)
+				return false;
+		} while (!m_used.compare_exchange_weak (used, used + size));
+
+		return true;
+	}
+
+	void MemoryBudget::acquire (size_t size)
+	{
+		m_used += size;
+	}
+
+	void MemoryBudget::release (size_t size)
+	{
+		m_used -= size;
+	}
+
+	bool MemoryBudget::isExhausted () const
+	{
+		return m_used.load () >= m_limit;
+	}
+}
@@ -36,9 +36,11 @@ namespace Laretz
 {
 	namespace ip = boost::asio::ip;
 
-	Server::Server ()
+	Server::Server (const ServerLimits& limits)
 	: m_acceptor (m_io)
 	, m_dbMgr (new DBManager)
+	, m_limits (limits)
+	, m_budget (new MemoryBudget (limits.m_maxTotalMemory))
 	{
 		std::string address = "127.0.0.1";
 		ip::tcp::resolver resolver (m_io);
@@ -64,7 +66,7 @@ namespace Laretz
 
 	void Server::startAccept ()
 	{
-		m_conn.reset (new ClientConnection (m_io, m_dbMgr));
+		m_conn.reset (new ClientConnection (m_io, m_dbMgr, m_limits, m_budget));
 		m_acceptor.async_accept (m_conn->getSocket (),
 				[this] (const boost::system::error_code& ec) { handleAccept (ec); });
 	}
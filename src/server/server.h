@@ -30,6 +30,8 @@
 
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include "serverlimits.h"
+#include "memorybudget.h"
 
 namespace Laretz
 {
@@ -42,8 +44,11 @@ namespace Laretz
 		boost::asio::ip::tcp::acceptor m_acceptor;
 		std::shared_ptr<ClientConnection> m_conn;
 		std::shared_ptr<DBManager> m_dbMgr;
+
+		const ServerLimits m_limits;
+		const MemoryBudget_ptr m_budget;
 	public:
-		Server ();
+		Server (const ServerLimits& = ServerLimits ());
 
 		void run ();
 	private:
@@ -0,0 +1,138 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#define BOOST_TEST_DYN_LINK
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <boost/test/unit_test.hpp>
+#include "operation.h"
+#include "packetgenerator.h"
+
+// Counts every heap allocation made by the test binary.
+namespace
+{
+	std::atomic<size_t> Allocations { 0 };
+	std::atomic<size_t> AllocatedBytes { 0 };
+}
+
+void* operator new (size_t size)
+{
+	++Allocations;
+	AllocatedBytes += size;
+	if (const auto ptr = std::malloc (size ? size : 1))
+		return ptr;
+	throw std::bad_alloc ();
+}
+
+void operator delete (void *ptr) noexcept
+{
+	std::free (ptr);
+}
+
+void operator delete (void *ptr, size_t) noexcept
+{
+	std::free (ptr);
+}
+
+using namespace Laretz;
+
+namespace
+{
+	const size_t PayloadSize = 4096;
+
+	struct Usage
+	{
+		size_t m_allocs;
+		size_t m_bytes;
+		size_t m_packetAllocs;
+	};
+
+	std::vector<Item> MakeItems (size_t count)
+	{
+		std::vector<Item> items;
+		items.reserve (count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			Item item { "item" + std::to_string (i), "parent", i + 1 };
+			item ["title"] = std::string (PayloadSize, 't');
+			item ["data"] = std::vector<char> (PayloadSize, 'd');
+			item ["mtime"] = static_cast<int64_t> (i);
+			items.push_back (std::move (item));
+		}
+		return items;
+	}
+
+	// Goes through the same steps as the server's Fetch: items loaded
+	// from the database are moved into the reply and on to the packet.
+	Usage Fetch (size_t count)
+	{
+		auto items = MakeItems (count);
+
+		const size_t allocsBefore = Allocations;
+		const size_t bytesBefore = AllocatedBytes;
+
+		Operation res { OpType::Fetch, std::vector<Item> () };
+		for (auto& item : items)
+			res += std::move (item);
+
+		std::vector<Operation> reply;
+		reply.push_back (std::move (res));
+
+		PacketGenerator pg { { { "Status", "Success" } } };
+		pg [std::move (reply)];
+
+		Usage usage { Allocations - allocsBefore, AllocatedBytes - bytesBefore, 0 };
+
+		const auto& packet = pg ();
+		BOOST_CHECK (packet.size () > 2 * count * PayloadSize);
+		usage.m_packetAllocs = Allocations - allocsBefore;
+		return usage;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE (Allocations)
+
+BOOST_AUTO_TEST_CASE (FetchIsLinear)
+{
+	const size_t count = 64;
+	const auto small = Fetch (count);
+	const auto large = Fetch (4 * count);
+
+	// A handful of allocations per item, growing linearly with the count.
+	BOOST_CHECK_LE (large.m_allocs, 4 * small.m_allocs + 64);
+	BOOST_CHECK_LE (large.m_packetAllocs, 4 * small.m_packetAllocs + 64);
+	BOOST_CHECK_LE (large.m_packetAllocs, 4 * count * 16);
+
+	// Copying a payload allocates at least its size once more per item,
+	// while moving only ever reallocates the item vector and the index.
+	BOOST_CHECK_LT (small.m_bytes, count * PayloadSize / 2);
+	BOOST_CHECK_LT (large.m_bytes, 4 * count * PayloadSize / 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
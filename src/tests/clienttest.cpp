@@ -0,0 +1,243 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#define BOOST_TEST_DYN_LINK
+#include <thread>
+#include <boost/test/unit_test.hpp>
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+#include "client.h"
+#include "operation.h"
+
+using namespace Laretz;
+namespace asio = boost::asio;
+using asio::ip::tcp;
+
+namespace
+{
+	void ReadRequest (tcp::socket& socket)
+	{
+		asio::streambuf buf;
+		const auto headerSize = asio::read_until (socket, buf, "\n\n");
+		const std::string header (asio::buffer_cast<const char*> (buf.data ()), headerSize);
+		const auto lengthStart = header.find ("Length: ") + 8;
+		const auto length = boost::lexical_cast<size_t> (header.substr (lengthStart,
+					header.find ('\n', lengthStart) - lengthStart));
+		if (buf.size () < headerSize + length)
+			asio::read (socket, buf, asio::transfer_exactly (headerSize + length - buf.size ()));
+	}
+
+	// Drops the first connection right away and answers one request on
+	// the second one.
+	void DropThenServe (asio::io_service& io, tcp::acceptor& acceptor, tcp::socket& socket)
+	{
+		{
+			tcp::socket dropped { io };
+			acceptor.accept (dropped);
+		}
+
+		acceptor.accept (socket);
+		ReadRequest (socket);
+
+		PacketGenerator pg { { { "Status", "Success" } } };
+		asio::write (socket, asio::buffer (pg ()));
+	}
+
+	ClientSettings MakeSettings (unsigned short port)
+	{
+		ClientSettings settings;
+		settings.m_host = "127.0.0.1";
+		settings.m_port = std::to_string (port);
+		settings.m_compress = false;
+		return settings;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE (Clients)
+
+// The first connection is dropped while a large request is still being
+// written, and the request is retried from its failure handler. The
+// completions left over from the dropped socket must not kill the retry.
+BOOST_AUTO_TEST_CASE (RetryFromFailureHandler)
+{
+	asio::io_service serverIo;
+	tcp::acceptor acceptor { serverIo, tcp::endpoint (asio::ip::address_v4::loopback (), 0) };
+	const auto port = acceptor.local_endpoint ().port ();
+
+	tcp::socket serverSocket { serverIo };
+	std::thread server ([&serverIo, &acceptor, &serverSocket]
+			{
+				try
+				{
+					DropThenServe (serverIo, acceptor, serverSocket);
+				}
+				catch (const std::exception&)
+				{
+				}
+			});
+
+	asio::io_service io;
+	Client client { io, MakeSettings (port) };
+
+	Item big { "big", 0 };
+	big ["data"] = std::string (16 * 1024 * 1024, 'x');
+
+	asio::deadline_timer timeout { io, boost::posix_time::seconds (10) };
+	timeout.async_wait ([&io] (const boost::system::error_code& ec)
+			{
+				if (!ec)
+					io.stop ();
+			});
+
+	bool firstFailed = false;
+	boost::system::error_code retryError = asio::error::timed_out;
+	client.send ({ { OpType::Append, { big } } },
+			[&] (const boost::system::error_code& ec, ParseResult&&)
+			{
+				if (!ec || firstFailed)
+					return;
+
+				firstFailed = true;
+				client.send ({ { OpType::List, { Item { "", 0 } } } },
+						[&] (const boost::system::error_code& ec, ParseResult&& result)
+						{
+							retryError = ec;
+							if (!ec)
+								BOOST_CHECK_EQUAL (result.fields ["Status"], "Success");
+							client.close ();
+							timeout.cancel ();
+						});
+			});
+
+	io.run ();
+
+	BOOST_CHECK (firstFailed);
+	BOOST_CHECK (!retryError);
+
+	// Unblocks the server wherever the client has left it.
+	if (retryError)
+	{
+		boost::system::error_code ignored;
+		serverSocket.shutdown (tcp::socket::shutdown_both, ignored);
+		for (int i = 0; i < 2; ++i)
+		{
+			tcp::socket poke { io };
+			poke.connect (acceptor.local_endpoint ());
+		}
+	}
+	server.join ();
+}
+
+BOOST_AUTO_TEST_CASE (FlushWithNothingQueued)
+{
+	asio::io_service io;
+	Client client { io, MakeSettings (1) };
+
+	bool called = false;
+	client.flush ([&called] (const boost::system::error_code& ec, ParseResult&& result)
+			{
+				called = true;
+				BOOST_CHECK (!ec);
+				BOOST_CHECK (result.operations.empty ());
+			});
+	io.run ();
+
+	BOOST_CHECK (called);
+}
+
+// A subscribed connection keeps reading after all the replies have
+// come. Anything but a notice there drops the connection instead of
+// being handed to a handler that doesn't exist.
+BOOST_AUTO_TEST_CASE (UnexpectedReply)
+{
+	asio::io_service serverIo;
+	tcp::acceptor acceptor { serverIo, tcp::endpoint (asio::ip::address_v4::loopback (), 0) };
+	tcp::socket serverSocket { serverIo };
+
+	bool dropped = false;
+	std::thread server ([&] ()
+			{
+				try
+				{
+					acceptor.accept (serverSocket);
+					ReadRequest (serverSocket);
+
+					PacketGenerator pg { { { "Status", "Success" } } };
+					asio::write (serverSocket, asio::buffer (pg ()));
+					asio::write (serverSocket, asio::buffer (pg ()));
+
+					char byte;
+					boost::system::error_code ec;
+					serverSocket.read_some (asio::buffer (&byte, 1), ec);
+					dropped = ec == asio::error::eof || ec == asio::error::connection_reset;
+				}
+				catch (const std::exception&)
+				{
+				}
+			});
+
+	asio::io_service io;
+	asio::deadline_timer timeout { io, boost::posix_time::seconds (10) };
+	timeout.async_wait ([&io] (const boost::system::error_code& ec)
+			{
+				if (!ec)
+					io.stop ();
+			});
+
+	Client client { io, MakeSettings (acceptor.local_endpoint ().port ()) };
+
+	boost::system::error_code noticeError;
+	client.setNotifyHandler ([&] (const boost::system::error_code& ec, ParseResult&&)
+			{
+				noticeError = ec;
+				timeout.cancel ();
+			});
+
+	int replies = 0;
+	client.subscribe ({ OpType::Subscribe, { Item { "", 0 } } },
+			[&replies] (const boost::system::error_code& ec, ParseResult&&)
+			{
+				if (!ec)
+					++replies;
+			});
+
+	io.run ();
+
+	if (!noticeError)
+	{
+		boost::system::error_code ignored;
+		serverSocket.shutdown (tcp::socket::shutdown_both, ignored);
+	}
+	server.join ();
+
+	BOOST_CHECK_EQUAL (replies, 1);
+	BOOST_CHECK (noticeError == boost::system::errc::protocol_error);
+	BOOST_CHECK (dropped);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
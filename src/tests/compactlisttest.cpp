@@ -0,0 +1,107 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#define BOOST_TEST_DYN_LINK
+#include <stdexcept>
+#include <boost/test/unit_test.hpp>
+#include "compactlist.h"
+#include "operation.h"
+#include "testutil.h"
+
+using namespace Laretz;
+
+namespace
+{
+	std::vector<Item> MakeItems ()
+	{
+		return
+		{
+			{ "a", "root", 10 },
+			{ "b", "root", 12 },
+			{ "c", "other", 7 },
+			{ "", "", 0 },
+			{ "d", "root", 1ull << 40 }
+		};
+	}
+}
+
+BOOST_AUTO_TEST_SUITE (CompactLists)
+
+BOOST_AUTO_TEST_CASE (RoundTrip)
+{
+	const auto& items = MakeItems ();
+	const auto& decoded = DecodeCompactList (EncodeCompactList (items));
+
+	BOOST_REQUIRE_EQUAL (decoded.size (), items.size ());
+	for (size_t i = 0; i < items.size (); ++i)
+		BOOST_CHECK (SameItems (decoded [i], items [i]));
+}
+
+BOOST_AUTO_TEST_CASE (Expand)
+{
+	const auto& items = MakeItems ();
+
+	auto op = MakeCompactList (items);
+	BOOST_CHECK_EQUAL (op.getItems ().size (), 1);
+	BOOST_CHECK (ExpandCompactList (op));
+	BOOST_CHECK_EQUAL (op.getItems ().size (), items.size ());
+
+	Operation plain { OpType::List, items };
+	BOOST_CHECK (!ExpandCompactList (plain));
+}
+
+BOOST_AUTO_TEST_CASE (TruncatedInput)
+{
+	const auto& data = EncodeCompactList (MakeItems ());
+	for (size_t size = 0; size < data.size (); ++size)
+		BOOST_CHECK_THROW (DecodeCompactList (data.substr (0, size)), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE (MalformedInput)
+{
+	// Unknown version.
+	BOOST_CHECK_THROW (DecodeCompactList (std::string (1, '\x02')), std::runtime_error);
+
+	// A huge dictionary size in a tiny packet.
+	const std::string hugeDict { '\x01', '\x00', '\xff', '\xff', '\xff', '\xff', '\x0f' };
+	BOOST_CHECK_THROW (DecodeCompactList (hugeDict), std::runtime_error);
+
+	// More items than bytes.
+	const std::string hugeCount { '\x01', '\x7f', '\x00' };
+	BOOST_CHECK_THROW (DecodeCompactList (hugeCount), std::runtime_error);
+
+	// A parent index outside of the dictionary.
+	const std::string badIndex { '\x01', '\x01', '\x01', '\x00', '\x05', '\x00', '\x00' };
+	BOOST_CHECK_THROW (DecodeCompactList (badIndex), std::runtime_error);
+
+	// A varint that never ends.
+	const std::string endlessVarint (12, '\xff');
+	BOOST_CHECK_THROW (DecodeCompactList ('\x01' + endlessVarint), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
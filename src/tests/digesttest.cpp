@@ -0,0 +1,166 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#define BOOST_TEST_DYN_LINK
+#include <map>
+#include <boost/test/unit_test.hpp>
+#include "digest.h"
+#include "operation.h"
+#include "replicastore.h"
+#include "testutil.h"
+
+using namespace Laretz;
+
+namespace
+{
+	// Keeps per-parent digests the way the server does: every change is
+	// applied to the item's parent and all of its ancestors.
+	class ServerDigests
+	{
+		std::map<std::string, std::string> m_parents;
+		std::map<std::string, uint64_t> m_seqs;
+		std::map<std::string, SubtreeDigest> m_digests;
+	public:
+		void append (const std::string& id, const std::string& parentId, uint64_t seq)
+		{
+			m_parents [id] = parentId;
+			m_seqs [id] = seq;
+			apply (parentId, DigestChange (id, 0, seq));
+		}
+
+		void modify (const std::string& id, uint64_t seq)
+		{
+			apply (m_parents [id], DigestChange (id, m_seqs [id], seq));
+			m_seqs [id] = seq;
+		}
+
+		void remove (const std::string& id)
+		{
+			apply (m_parents [id], DigestChange (id, m_seqs [id], 0, m_digests [id]));
+			m_parents.erase (id);
+		}
+
+		SubtreeDigest get (const std::string& parentId)
+		{
+			return m_digests [parentId];
+		}
+	private:
+		void apply (std::string parentId, const SubtreeDigest& change)
+		{
+			while (true)
+			{
+				m_digests [parentId] += change;
+				if (parentId.empty ())
+					break;
+				parentId = m_parents [parentId];
+			}
+		}
+	};
+}
+
+BOOST_AUTO_TEST_SUITE (Digests)
+
+BOOST_AUTO_TEST_CASE (OrderIndependent)
+{
+	SubtreeDigest forward;
+	forward.add ("a", 1);
+	forward.add ("b", 2);
+
+	SubtreeDigest backward;
+	backward.add ("b", 2);
+	backward.add ("a", 1);
+
+	BOOST_CHECK (forward == backward);
+	BOOST_CHECK_EQUAL (forward.m_count, 2);
+
+	SubtreeDigest other;
+	other.add ("a", 1);
+	other.add ("b", 3);
+	BOOST_CHECK (forward != other);
+}
+
+BOOST_AUTO_TEST_CASE (ServerUpdatesMatchRebuild)
+{
+	ServerDigests server;
+	server.append ("a", "", 1);
+	server.append ("b", "a", 2);
+	server.append ("c", "b", 3);
+	server.append ("d", "", 4);
+
+	server.modify ("c", 5);
+
+	SubtreeDigest rebuilt;
+	rebuilt.add ("a", 1);
+	rebuilt.add ("b", 2);
+	rebuilt.add ("c", 5);
+	rebuilt.add ("d", 4);
+	BOOST_CHECK (server.get ("") == rebuilt);
+
+	// Removing a non-leaf item drops its whole subtree.
+	server.remove ("b");
+
+	SubtreeDigest remaining;
+	remaining.add ("a", 1);
+	remaining.add ("d", 4);
+	BOOST_CHECK (server.get ("") == remaining);
+	BOOST_CHECK (server.get ("a") == SubtreeDigest ());
+}
+
+BOOST_AUTO_TEST_CASE (ReplicaFollowsChanges)
+{
+	TempFile file;
+	ReplicaStore store { file.getPath () };
+
+	store.apply ({ OpType::Append, { Item { "a", "", 1 }, Item { "b", "", 2 }, Item { "c", "a", 3 } } });
+
+	SubtreeDigest expected;
+	expected.add ("a", 1);
+	expected.add ("b", 2);
+	expected.add ("c", 3);
+	BOOST_CHECK (store.getDigest ("") == expected);
+
+	store.apply ({ OpType::Modify, { Item { "c", "a", 4 } } });
+	expected += DigestChange ("c", 3, 4);
+	BOOST_CHECK (store.getDigest ("") == expected);
+
+	SubtreeDigest subtree;
+	subtree.add ("c", 4);
+	BOOST_CHECK (store.getDigest ("a") == subtree);
+
+	store.apply ({ OpType::Delete, { Item { "b", 5 } } });
+	expected -= DigestChange ("b", 0, 2);
+	BOOST_CHECK (store.getDigest ("") == expected);
+
+	// Same as the server does on removing a non-leaf item.
+	expected += DigestChange ("a", 1, 0, store.getDigest ("a"));
+	store.apply ({ OpType::Delete, { Item { "a", 6 } } });
+	BOOST_CHECK (store.getDigest ("") == expected);
+	BOOST_CHECK (store.getDigest ("") == SubtreeDigest ());
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
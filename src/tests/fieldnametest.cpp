@@ -0,0 +1,82 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#define BOOST_TEST_DYN_LINK
+#include <thread>
+#include <boost/test/unit_test.hpp>
+#include "fieldname.h"
+
+using namespace Laretz;
+
+BOOST_AUTO_TEST_SUITE (FieldNames)
+
+BOOST_AUTO_TEST_CASE (NamesAreInternedOnFirstSight)
+{
+	BOOST_CHECK (FieldName ("cursor").isInterned ());
+
+	const FieldName first { "someTitle" };
+	const FieldName second { std::string ("some") + "Title" };
+	BOOST_CHECK (first.isInterned ());
+	BOOST_CHECK (first == second);
+	BOOST_CHECK (&first.str () == &second.str ());
+
+	BOOST_CHECK (!FieldName (std::string (FieldName::MaxInternedLength + 1, 'a')).isInterned ());
+}
+
+BOOST_AUTO_TEST_CASE (RegisteredNames)
+{
+	FieldName::Intern ("registeredTitle");
+	const FieldName name { "registeredTitle" };
+	BOOST_CHECK (name.isInterned ());
+
+	BOOST_CHECK (FieldName ("a") < name);
+	BOOST_CHECK (!(name < FieldName ("registeredTitle")));
+	BOOST_CHECK (name != FieldName ("cursor"));
+}
+
+// Fills the table for the rest of the process, so it goes last.
+BOOST_AUTO_TEST_CASE (TableIsBounded)
+{
+	const FieldName known { "knownBeforeFull" };
+
+	for (int i = 0; i < FieldName::MaxInternedNames; ++i)
+		FieldName ("junk" + std::to_string (i));
+
+	const FieldName junk { "junkAfterFull" };
+	BOOST_CHECK (!junk.isInterned ());
+	BOOST_CHECK (junk == FieldName ("junkAfterFull"));
+	BOOST_CHECK (junk != known);
+
+	BOOST_CHECK (FieldName ("knownBeforeFull").isInterned ());
+
+	bool otherThread = false;
+	std::thread { [&otherThread] { otherThread = FieldName ("knownBeforeFull").isInterned (); } }.join ();
+	BOOST_CHECK (otherThread);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
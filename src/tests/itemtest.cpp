@@ -0,0 +1,74 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "operation.h"
+#include "packetgenerator.h"
+#include "packetparser.h"
+
+using namespace Laretz;
+
+BOOST_AUTO_TEST_SUITE (Items)
+
+BOOST_AUTO_TEST_CASE (FieldsStaySorted)
+{
+	Item item { "id", 1 };
+	item ["c"] = std::string ("3");
+	item ["a"] = std::string ("1");
+	item ["b"] = std::string ("2");
+	item ["a"] = std::string ("4");
+
+	std::vector<std::string> names;
+	for (const auto& field : item)
+		names.push_back (field.first.str ());
+	BOOST_CHECK ((names == std::vector<std::string> { "a", "b", "c" }));
+	BOOST_CHECK (boost::get<std::string> (item ["a"]) == "4");
+}
+
+BOOST_AUTO_TEST_CASE (SortedDuplicatesAreDropped)
+{
+	Item item { "id", 1 };
+	item ["fa"] = std::string ("x");
+	item ["fb"] = std::string ("y");
+
+	PacketGenerator pg;
+	pg (Operation { OpType::Append, { item } });
+	auto packet = pg ();
+
+	// Both names still come in order, but now they are the same.
+	const auto pos = packet.find ("2 fb");
+	BOOST_REQUIRE_NE (pos, std::string::npos);
+	packet.replace (pos, 4, "2 fa");
+
+	const auto& parsed = Parse (packet).operations.at (0).getItems ().at (0);
+	BOOST_REQUIRE_EQUAL (std::distance (parsed.begin (), parsed.end ()), 1);
+	BOOST_CHECK (boost::get<std::string> (parsed ["fa"]) == "x");
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
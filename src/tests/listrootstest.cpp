@@ -0,0 +1,150 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#define BOOST_TEST_DYN_LINK
+#include <map>
+#include <set>
+#include <boost/test/unit_test.hpp>
+#include "item.h"
+#include "listroots.h"
+
+using namespace Laretz;
+
+namespace
+{
+	// Seqs are kept the way the server keeps them: a change bumps the
+	// item and its direct parent only.
+	class Tree
+	{
+		struct Node
+		{
+			std::string m_parentId;
+			uint64_t m_seq;
+		};
+		std::map<std::string, Node> m_nodes;
+	public:
+		void change (const std::string& id, const std::string& parentId, uint64_t seq)
+		{
+			m_nodes [id] = { parentId, seq };
+			if (!parentId.empty ())
+				m_nodes [parentId].m_seq = seq;
+		}
+
+		std::vector<std::string> getChildren (const std::string& parentId, uint64_t after) const
+		{
+			std::vector<std::string> result;
+			for (const auto& pair : m_nodes)
+				if (pair.second.m_parentId == parentId && pair.second.m_seq > after)
+					result.push_back (pair.first);
+			return result;
+		}
+	};
+
+	// Walks the roots the way ListStream does.
+	std::set<std::string> List (const Tree& tree, const std::vector<Item>& request)
+	{
+		const auto& roots = SelectListRoots (request);
+		const NestedRoots nested { roots };
+
+		std::set<std::string> result;
+		for (const auto& root : roots)
+		{
+			std::vector<std::string> pending { root.m_parentId };
+			while (!pending.empty ())
+			{
+				const auto parentId = pending.back ();
+				pending.pop_back ();
+
+				for (const auto& id : tree.getChildren (parentId, root.m_after))
+				{
+					result.insert (id);
+					if (!nested.isCovered (id, root.m_after))
+						pending.push_back (id);
+				}
+			}
+		}
+		return result;
+	}
+
+	// a -> q -> p -> x
+	Tree MakeTree ()
+	{
+		Tree tree;
+		tree.change ("a", "", 1);
+		tree.change ("q", "a", 2);
+		tree.change ("p", "q", 3);
+		tree.change ("x", "p", 4);
+		return tree;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE (ListRoots)
+
+BOOST_AUTO_TEST_CASE (SameParentRootsMerge)
+{
+	const auto& roots = SelectListRoots ({ { "", "a", 50 }, { "", "a", 30 }, { "", "p", 100 } });
+	BOOST_REQUIRE_EQUAL (roots.size (), 2);
+	BOOST_CHECK_EQUAL (roots [0].m_parentId, "a");
+	BOOST_CHECK_EQUAL (roots [0].m_after, 30);
+	BOOST_CHECK_EQUAL (roots [0].m_index, 1);
+	BOOST_CHECK_EQUAL (roots [1].m_parentId, "p");
+}
+
+// The ancestor's walk never gets to p, as q's seq stays old.
+BOOST_AUTO_TEST_CASE (DeepChangeUnderNestedRoot)
+{
+	auto tree = MakeTree ();
+	tree.change ("x", "p", 200);
+
+	BOOST_CHECK (List (tree, { { "", "p", 100 } }).count ("x"));
+	BOOST_CHECK (List (tree, { { "", "a", 50 }, { "", "p", 100 } }).count ("x"));
+}
+
+// The nested root lists from a newer seq than the walk reaching it.
+BOOST_AUTO_TEST_CASE (NestedRootWithNewerSeq)
+{
+	auto tree = MakeTree ();
+	tree.change ("q", "a", 60);
+	tree.change ("y", "p", 70);
+
+	const auto& listed = List (tree, { { "", "a", 50 }, { "", "p", 100 } });
+	BOOST_CHECK (listed.count ("q"));
+	BOOST_CHECK (listed.count ("p"));
+	BOOST_CHECK (listed.count ("y"));
+}
+
+BOOST_AUTO_TEST_CASE (NestedRootWithOlderSeqIsSkipped)
+{
+	NestedRoots nested { SelectListRoots ({ { "", "a", 50 }, { "", "p", 10 } }) };
+	BOOST_CHECK (nested.isCovered ("p", 50));
+	BOOST_CHECK (nested.isCovered ("p", 10));
+	BOOST_CHECK (!nested.isCovered ("p", 5));
+	BOOST_CHECK (!nested.isCovered ("q", 50));
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,258 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#define BOOST_TEST_DYN_LINK
+#include <map>
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include "dberror.h"
+#include "liststream.h"
+#include "operation.h"
+
+using namespace Laretz;
+
+namespace
+{
+	// Keeps items in memory and returns them in the order the database does.
+	class MemorySource : public ListSource
+	{
+		class VectorCursor : public Cursor
+		{
+			std::vector<Item> m_items;
+			size_t m_pos;
+		public:
+			VectorCursor (std::vector<Item>&& items)
+			: m_items (std::move (items))
+			, m_pos (0)
+			{
+			}
+
+			bool more ()
+			{
+				return m_pos < m_items.size ();
+			}
+
+			Item next ()
+			{
+				return m_items [m_pos++];
+			}
+		};
+
+		std::map<std::string, Item> m_items;
+		std::vector<Item> m_removed;
+	public:
+		void add (const std::string& id, const std::string& parentId, uint64_t seq)
+		{
+			Item item { id, parentId, seq };
+			item ["title"] = "title of " + id;
+			m_items [id] = item;
+		}
+
+		void remove (const std::string& id, uint64_t seq)
+		{
+			m_items.erase (id);
+			m_removed.push_back ({ id, seq });
+		}
+
+		bool hasItem (const std::string& id) const
+		{
+			return m_items.count (id);
+		}
+
+		Cursor_ptr queryChildren (const std::string& parentId, uint64_t after,
+				uint64_t lastSeq, const std::string& lastId) const
+		{
+			std::vector<Item> result;
+			for (const auto& pair : m_items)
+				if (pair.second.getParentId () == parentId)
+					result.push_back (pair.second);
+			return Select (std::move (result), after, lastSeq, lastId);
+		}
+
+		Cursor_ptr queryRemoved (uint64_t after,
+				uint64_t lastSeq, const std::string& lastId) const
+		{
+			return Select (std::vector<Item> (m_removed), after, lastSeq, lastId);
+		}
+	private:
+		static Cursor_ptr Select (std::vector<Item>&& items, uint64_t after,
+				uint64_t lastSeq, const std::string& lastId)
+		{
+			const auto position = [] (const Item& item) { return std::make_pair (item.getSeq (), item.getId ()); };
+			const auto last = std::make_pair (lastSeq, lastId);
+
+			std::vector<Item> result;
+			for (auto& item : items)
+				if (item.getSeq () > after && (lastId.empty () || position (item) > last))
+					result.push_back (std::move (item));
+
+			std::sort (result.begin (), result.end (),
+					[&position] (const Item& left, const Item& right) { return position (left) < position (right); });
+			return Cursor_ptr (new VectorCursor (std::move (result)));
+		}
+	};
+
+	struct Listing
+	{
+		std::vector<std::string> m_listed;
+		std::vector<std::string> m_removed;
+		std::vector<Item> m_bodies;
+		size_t m_chunks = 0;
+	};
+
+	// Lists everything like a client would, continuing every chunk from
+	// its cursor with a new stream.
+	Listing ListAll (const ListSource_ptr& source, const std::vector<ListRoot>& roots,
+			uint64_t removedAfter, size_t chunkSize, const ListBodyOptions& bodyOptions = ListBodyOptions ())
+	{
+		Listing listing;
+		std::string cursor;
+		while (listing.m_chunks < 100)
+		{
+			ListStream stream { source, roots, removedAfter, cursor, 0, bodyOptions };
+			const auto& ops = stream.nextOps (chunkSize);
+			++listing.m_chunks;
+
+			BOOST_CHECK (std::any_of (ops.begin (), ops.end (),
+					[] (const Operation& op) { return op.getType () == OpType::List; }));
+
+			for (const auto& op : ops)
+				for (const auto& item : op.getItems ())
+					switch (op.getType ())
+					{
+					case OpType::List:
+						listing.m_listed.push_back (item.getId ());
+						break;
+					case OpType::Delete:
+						listing.m_removed.push_back (item.getId ());
+						break;
+					default:
+						listing.m_bodies.push_back (item);
+						break;
+					}
+
+			if (stream.isComplete ())
+				break;
+			cursor = stream.getCursor ();
+		}
+		return listing;
+	}
+
+	// a -> { c, d }, b -> e
+	std::shared_ptr<MemorySource> MakeSource ()
+	{
+		const auto source = std::make_shared<MemorySource> ();
+		source->add ("a", "", 1);
+		source->add ("b", "", 2);
+		source->add ("c", "a", 3);
+		source->add ("d", "a", 4);
+		source->add ("e", "b", 5);
+		return source;
+	}
+
+	std::vector<std::string> Sorted (std::vector<std::string> ids)
+	{
+		std::sort (ids.begin (), ids.end ());
+		return ids;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE (ListStreams)
+
+BOOST_AUTO_TEST_CASE (ChunksResumeFromCursor)
+{
+	const auto source = MakeSource ();
+	const auto& listing = ListAll (source, { { "", 0, 0 } }, 0, 2);
+
+	const std::vector<std::string> expected { "a", "b", "c", "d", "e" };
+	BOOST_CHECK (Sorted (listing.m_listed) == expected);
+	BOOST_CHECK_EQUAL (listing.m_chunks, 3);
+}
+
+BOOST_AUTO_TEST_CASE (OnlyChangedItems)
+{
+	const auto source = MakeSource ();
+	const auto& listing = ListAll (source, { { "a", 3, 0 } }, 3, 10);
+
+	BOOST_CHECK (listing.m_listed == std::vector<std::string> { "d" });
+	BOOST_CHECK_EQUAL (listing.m_chunks, 1);
+}
+
+// A batch removes everything with the same seq, so the cursor has to
+// tell the removed items apart by their ids too.
+BOOST_AUTO_TEST_CASE (RemovedArePaged)
+{
+	const auto source = MakeSource ();
+	for (const auto& id : { "r1", "r2", "r3", "r4", "r5" })
+		source->remove (id, 6);
+	source->remove ("old", 1);
+
+	const auto& listing = ListAll (source, { { "", 0, 0 } }, 2, 2);
+	BOOST_CHECK_EQUAL (listing.m_listed.size (), 5);
+
+	const std::vector<std::string> removed { "r1", "r2", "r3", "r4", "r5" };
+	BOOST_CHECK (listing.m_removed == removed);
+	BOOST_CHECK_EQUAL (listing.m_chunks, 5);
+}
+
+BOOST_AUTO_TEST_CASE (SeveralRoots)
+{
+	const auto source = MakeSource ();
+	const auto& listing = ListAll (source, { { "a", 0, 0 }, { "b", 0, 1 } }, 5, 1);
+
+	const std::vector<std::string> expected { "c", "d", "e" };
+	BOOST_CHECK (listing.m_listed == expected);
+	BOOST_CHECK_EQUAL (listing.m_chunks, 3);
+}
+
+BOOST_AUTO_TEST_CASE (Bodies)
+{
+	const auto source = MakeSource ();
+
+	ListBodyOptions bodyOptions;
+	bodyOptions.m_enabled = true;
+	const auto& listing = ListAll (source, { { "a", 0, 0 } }, 5, 1, bodyOptions);
+
+	BOOST_REQUIRE_EQUAL (listing.m_bodies.size (), 2);
+	BOOST_CHECK_EQUAL (listing.m_bodies [0].getId (), "c");
+	BOOST_CHECK (listing.m_bodies [0].find ("title"));
+}
+
+BOOST_AUTO_TEST_CASE (BadCursors)
+{
+	const auto source = MakeSource ();
+	const std::vector<ListRoot> roots { { "a", 0, 0 }, { "b", 0, 1 } };
+
+	BOOST_CHECK_THROW (ListStream (source, roots, 0, "nocolon"), DBError);
+	BOOST_CHECK_THROW (ListStream (source, roots, 0, "5:"), DBError);
+	BOOST_CHECK_THROW (ListStream (source, roots, 0, "0:nodash"), DBError);
+	BOOST_CHECK_THROW (ListStream (source, roots, 0, "~nodash"), DBError);
+	BOOST_CHECK_THROW (ListStream (source, { { "missing", 0, 0 } }, 0), UnknownParentError);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,77 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#define BOOST_TEST_DYN_LINK
+#include <thread>
+#include <boost/test/unit_test.hpp>
+#include "operation.h"
+
+using namespace Laretz;
+
+BOOST_AUTO_TEST_SUITE (Operations)
+
+BOOST_AUTO_TEST_CASE (ContainsTracksChanges)
+{
+	Operation op { OpType::Modify, { Item { "a", 1 }, Item { "b", 1 } } };
+	BOOST_CHECK (op.contains ("a"));
+	BOOST_CHECK (!op.contains ("c"));
+
+	op.getItems ().front ().setId ("c");
+	BOOST_CHECK (op.contains ("c"));
+	BOOST_CHECK (!op.contains ("a"));
+
+	op += Item { "d", 2 };
+	BOOST_CHECK (op.contains ("d"));
+	BOOST_CHECK ((op -= Item { "c", 0 }));
+	BOOST_CHECK (!op.contains ("c"));
+	BOOST_CHECK_EQUAL (op.getItems ().size (), 2);
+}
+
+BOOST_AUTO_TEST_CASE (ConcurrentConstLookups)
+{
+	std::vector<Item> items;
+	for (int i = 0; i < 1000; ++i)
+		items.emplace_back (std::to_string (i), 1);
+	const Operation op { OpType::Append, std::move (items) };
+
+	std::vector<std::thread> threads;
+	std::vector<int> found (4, 0);
+	for (size_t t = 0; t < found.size (); ++t)
+		threads.emplace_back ([&op, &found, t]
+				{
+					for (int i = 0; i < 2000; ++i)
+						found [t] += op.contains (std::to_string (i));
+				});
+	for (auto& thread : threads)
+		thread.join ();
+
+	for (const auto count : found)
+		BOOST_CHECK_EQUAL (count, 1000);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
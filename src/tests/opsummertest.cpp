@@ -0,0 +1,95 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "opsummer.h"
+
+using namespace Laretz;
+
+namespace
+{
+	Item MakeItem (const std::string& id, uint64_t seq, const std::string& field, int64_t value)
+	{
+		Item item { id, seq };
+		item [field] = value;
+		return item;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE (OpSummers)
+
+BOOST_AUTO_TEST_CASE (NonOverlappingModifiesMerge)
+{
+	OpSummer summer;
+	summer += Operation { OpType::Modify, { MakeItem ("a", 3, "x", 1) } };
+	summer += Operation { OpType::Modify, { MakeItem ("a", 3, "y", 2), MakeItem ("b", 1, "x", 3) } };
+
+	const auto& ops = summer.takeOps ();
+	BOOST_REQUIRE_EQUAL (ops.size (), 1);
+	BOOST_CHECK (ops.front ().getType () == OpType::Modify);
+
+	const auto& items = ops.front ().getItems ();
+	BOOST_REQUIRE_EQUAL (items.size (), 2);
+	BOOST_CHECK_EQUAL (items [0].getId (), "a");
+	BOOST_CHECK_EQUAL (boost::get<int64_t> (items [0] ["x"]), 1);
+	BOOST_CHECK_EQUAL (boost::get<int64_t> (items [0] ["y"]), 2);
+	BOOST_CHECK_EQUAL (items [1].getId (), "b");
+
+	BOOST_CHECK (summer.takeOps ().empty ());
+}
+
+BOOST_AUTO_TEST_CASE (LaterModifyWins)
+{
+	OpSummer summer;
+	summer += Operation { OpType::Modify, { MakeItem ("a", 3, "x", 1) } };
+	summer += Operation { OpType::Modify, { MakeItem ("a", 3, "x", 2) } };
+
+	const auto& ops = summer.getOps ();
+	BOOST_REQUIRE_EQUAL (ops.size (), 1);
+	BOOST_REQUIRE_EQUAL (ops.front ().getItems ().size (), 1);
+	BOOST_CHECK_EQUAL (boost::get<int64_t> (ops.front ().getItems ().front () ["x"]), 2);
+}
+
+BOOST_AUTO_TEST_CASE (AppendAbsorbsModifyAndDelete)
+{
+	OpSummer summer;
+	summer += Operation { OpType::Append, { MakeItem ("a", 0, "x", 1) } };
+	summer += Operation { OpType::Modify, { MakeItem ("a", 0, "y", 2) } };
+
+	const auto& ops = summer.getOps ();
+	BOOST_REQUIRE_EQUAL (ops.size (), 1);
+	BOOST_CHECK (ops.front ().getType () == OpType::Append);
+	BOOST_CHECK_EQUAL (std::distance (ops.front ().getItems ().front ().begin (),
+				ops.front ().getItems ().front ().end ()), 2);
+
+	summer += Operation { OpType::Delete, { Item { "a", 0 } } };
+	BOOST_CHECK (summer.takeOps ().empty ());
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,137 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "operation.h"
+#include "packetgenerator.h"
+#include "packetparser.h"
+#include "compression.h"
+#include "testutil.h"
+
+using namespace Laretz;
+
+namespace
+{
+	std::vector<Operation> MakeOps ()
+	{
+		Item item { "id1", "parent", 5 };
+		item ["title"] = std::string ("hello\nworld");
+		item ["mtime"] = static_cast<int64_t> (42);
+		item ["ratio"] = 0.5;
+		item ["tags"] = std::vector<std::string> { "x", "y" };
+		item ["blob"] = std::vector<char> { 'a', '\0', '\n', 'c' };
+
+		return { { OpType::Append, { item } }, { OpType::List, { Item { "", "p", 3 } } } };
+	}
+
+	void CheckSame (const std::vector<Operation>& left, const std::vector<Operation>& right)
+	{
+		BOOST_REQUIRE_EQUAL (left.size (), right.size ());
+		for (size_t i = 0; i < left.size (); ++i)
+		{
+			BOOST_CHECK (left [i].getType () == right [i].getType ());
+			BOOST_REQUIRE_EQUAL (left [i].getItems ().size (), right [i].getItems ().size ());
+			for (size_t j = 0; j < left [i].getItems ().size (); ++j)
+				BOOST_CHECK (SameItems (left [i].getItems () [j], right [i].getItems () [j]));
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE (Packets)
+
+BOOST_AUTO_TEST_CASE (RoundTrip)
+{
+	const auto& ops = MakeOps ();
+
+	PacketGenerator pg { { { "Login", "user" }, { "Cursor", "5-6162" } } };
+	pg [ops];
+
+	const auto& result = Parse (pg ());
+	BOOST_CHECK_EQUAL (result.fields.at ("Login"), "user");
+	BOOST_CHECK_EQUAL (result.fields.at ("Cursor"), "5-6162");
+	CheckSame (ops, result.operations);
+}
+
+BOOST_AUTO_TEST_CASE (MultiRootCursorRoundTrip)
+{
+	const std::string cursor { "1:5-6162.7-6364" };
+
+	PacketGenerator pg { { { "Cursor", cursor } } };
+	pg [MakeOps ()];
+
+	const auto& result = Parse (pg ());
+	BOOST_REQUIRE (result.fields.count ("Cursor"));
+	BOOST_CHECK_EQUAL (result.fields.at ("Cursor"), cursor);
+}
+
+BOOST_AUTO_TEST_CASE (CompressedRoundTrip)
+{
+	std::vector<Operation> ops;
+	for (int i = 0; i < 100; ++i)
+		ops.push_back ({ OpType::Append, MakeOps ().front ().getItems () });
+
+	Deflater deflater;
+	Inflater inflater;
+
+	PacketGenerator pg;
+	pg [ops];
+	const auto& packet = pg (deflater);
+	BOOST_CHECK_NE (packet.find ("Content-Encoding: deflate"), std::string::npos);
+
+	CheckSame (ops, Parse (packet, inflater).operations);
+	BOOST_CHECK_THROW (Parse (packet), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE (SizeBound)
+{
+	std::vector<char> noise (256 * 1024);
+	uint32_t state = 1;
+	for (auto& c : noise)
+	{
+		state = state * 1103515245 + 12345;
+		c = static_cast<char> (state >> 24);
+	}
+
+	Item item { "noise", 1 };
+	item ["data"] = noise;
+
+	PacketGenerator pg { { { "Status", "Success" } } };
+	pg (Operation { OpType::Fetch, { item } });
+
+	Deflater deflater;
+	const auto& serialized = pg.serialize ();
+	const auto bound = pg.getSizeBound (serialized, deflater);
+	BOOST_CHECK_LE (pg (serialized).size (), bound);
+
+	// The deflate stream is shared by all the packets of a connection.
+	for (int i = 0; i < 3; ++i)
+		BOOST_CHECK_LE (pg (serialized, deflater).size (), bound);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,96 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "replicastore.h"
+#include "packetparser.h"
+#include "operation.h"
+#include "testutil.h"
+
+using namespace Laretz;
+
+BOOST_AUTO_TEST_SUITE (ReplicaStoreTest)
+
+BOOST_AUTO_TEST_CASE (OwnChangesKeepMaxSeq)
+{
+	TempFile file;
+	ReplicaStore store { file.getPath () };
+
+	store.apply (ParseResult { { { "Status", "Success" } },
+			{ { OpType::Append, { Item { "a", "", 7 } } } } });
+	store.apply (ParseResult { { { "Status", "Notify" } },
+			{ { OpType::Modify, { Item { "a", "", 8 } } } } });
+
+	BOOST_CHECK (store.contains ("a"));
+	BOOST_CHECK_EQUAL (store.getMaxSeq (), 0);
+}
+
+BOOST_AUTO_TEST_CASE (PartialListKeepsMaxSeq)
+{
+	TempFile file;
+	ReplicaStore store { file.getPath () };
+
+	store.apply (ParseResult { { { "Status", "Partial" }, { "Cursor", "5-61" } },
+			{ { OpType::List, { Item { "a", 5 } } } } });
+	BOOST_CHECK_EQUAL (store.getMaxSeq (), 0);
+
+	store.apply (ParseResult { { { "Status", "Success" } },
+			{ { OpType::List, { Item { "b", 3 } } }, { OpType::Delete, { Item { "c", 4 } } } } });
+	BOOST_CHECK_EQUAL (store.getMaxSeq (), 5);
+}
+
+BOOST_AUTO_TEST_CASE (ErrorDropsPartialList)
+{
+	TempFile file;
+	ReplicaStore store { file.getPath () };
+
+	store.apply (ParseResult { { { "Status", "Partial" }, { "Cursor", "9-61" } },
+			{ { OpType::List, { Item { "a", 9 } } } } });
+	store.apply (ParseResult { { { "Status", "Error" } }, {} });
+	store.apply (ParseResult { { { "Status", "Success" } },
+			{ { OpType::List, { Item { "b", 2 } } } } });
+	BOOST_CHECK_EQUAL (store.getMaxSeq (), 2);
+}
+
+BOOST_AUTO_TEST_CASE (MaxSeqSurvivesReload)
+{
+	TempFile file;
+	{
+		ReplicaStore store { file.getPath () };
+		store.apply (ParseResult { { { "Status", "Success" } },
+				{ { OpType::List, { Item { "a", 6 } } } } });
+		store.apply ({ OpType::Append, { Item { "b", "", 10 } } });
+		store.compact ();
+	}
+
+	ReplicaStore store { file.getPath () };
+	BOOST_CHECK_EQUAL (store.getMaxSeq (), 6);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,77 @@
+/**********************************************************************
+ * Copyright 2013 Georg Rudoy <0xd34df00d@gmail.com>
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **********************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <stdexcept>
+#include <cstdlib>
+#include <unistd.h>
+#include "item.h"
+
+namespace Laretz
+{
+	inline bool SameItems (const Item& left, const Item& right)
+	{
+		return left.getId () == right.getId () &&
+				left.getParentId () == right.getParentId () &&
+				left.getSeq () == right.getSeq () &&
+				std::distance (left.begin (), left.end ()) == std::distance (right.begin (), right.end ()) &&
+				std::equal (left.begin (), left.end (), right.begin ());
+	}
+
+	// A fresh empty file removed along with the object.
+	class TempFile
+	{
+		std::string m_path;
+	public:
+		TempFile ()
+		{
+			char name [] = "/tmp/laretz_testXXXXXX";
+			const auto fd = ::mkstemp (name);
+			if (fd < 0)
+				throw std::runtime_error ("cannot create a temporary file");
+			::close (fd);
+			m_path = name;
+		}
+
+		~TempFile ()
+		{
+			::unlink (m_path.c_str ());
+		}
+
+		TempFile (const TempFile&) = delete;
+		TempFile& operator= (const TempFile&) = delete;
+
+		const std::string& getPath () const
+		{
+			return m_path;
+		}
+	};
+}